@@ -11,3 +11,4 @@
 #define IDS_WND_CLOSED_INFO             105
 #define IDS_WND_ACCESS_DENIED_INFO      106
 #define IDS_FATAL_MSGBOX_TITLE          107
+#define IDS_ENFORCE_TOPMOST             108
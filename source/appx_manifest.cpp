@@ -0,0 +1,273 @@
+#include "appx_manifest.h"
+
+#include <cstdint>
+
+namespace {
+
+bool is_space(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+bool is_name_end(char ch) {
+  return is_space(ch) || ch == '/' || ch == '>' || ch == '=' || ch == '<' ||
+         ch == '"' || ch == '\'';
+}
+
+std::string_view local_name(std::string_view name) {
+  auto colon{name.rfind(':')};
+  return colon == std::string_view::npos ? name : name.substr(colon + 1);
+}
+
+bool starts_with(std::string_view s, std::string_view prefix) {
+  return s.substr(0, prefix.size()) == prefix;
+}
+
+void append_utf8(std::string &out, std::uint32_t cp) {
+  if (cp < 0x80) {
+    out.push_back(char(cp));
+  } else if (cp < 0x800) {
+    out.push_back(char(0xc0 | cp >> 6));
+    out.push_back(char(0x80 | (cp & 0x3f)));
+  } else if (cp < 0x10000) {
+    out.push_back(char(0xe0 | cp >> 12));
+    out.push_back(char(0x80 | (cp >> 6 & 0x3f)));
+    out.push_back(char(0x80 | (cp & 0x3f)));
+  } else {
+    out.push_back(char(0xf0 | cp >> 18));
+    out.push_back(char(0x80 | (cp >> 12 & 0x3f)));
+    out.push_back(char(0x80 | (cp >> 6 & 0x3f)));
+    out.push_back(char(0x80 | (cp & 0x3f)));
+  }
+}
+
+class manifest_scanner {
+public:
+  explicit manifest_scanner(std::string_view xml) : xml{xml} {}
+
+  std::optional<std::vector<appx_application>> scan() {
+    if (starts_with(xml, "\xef\xbb\xbf")) {
+      pos = 3;
+    }
+    while (true) {
+      pos = xml.find('<', pos);
+      if (pos == std::string_view::npos) {
+        break;
+      }
+      auto rest{xml.substr(pos)};
+      bool ok;
+      if (starts_with(rest, "<!--")) {
+        pos += 4;
+        ok = skip_past("-->");
+      } else if (starts_with(rest, "<![CDATA[")) {
+        pos += 9;
+        ok = skip_past("]]>");
+      } else if (starts_with(rest, "<?")) {
+        pos += 2;
+        ok = skip_past("?>");
+      } else if (starts_with(rest, "<!")) {
+        ok = false;
+      } else if (starts_with(rest, "</")) {
+        pos += 2;
+        ok = end_tag();
+      } else {
+        pos += 1;
+        ok = start_tag();
+      }
+      if (!ok) {
+        return std::nullopt;
+      }
+    }
+    if (in_application || apps.empty()) {
+      return std::nullopt;
+    }
+    return std::move(apps);
+  }
+
+private:
+  bool skip_past(std::string_view terminator) {
+    auto end{xml.find(terminator, pos)};
+    if (end == std::string_view::npos) {
+      return false;
+    }
+    pos = end + terminator.size();
+    return true;
+  }
+
+  void skip_spaces() {
+    while (pos < xml.size() && is_space(xml[pos])) {
+      ++pos;
+    }
+  }
+
+  std::optional<std::string_view> read_name() {
+    auto start{pos};
+    while (pos < xml.size() && !is_name_end(xml[pos])) {
+      ++pos;
+    }
+    if (pos == start) {
+      return std::nullopt;
+    }
+    return xml.substr(start, pos - start);
+  }
+
+  bool end_tag() {
+    auto name{read_name()};
+    if (!name) {
+      return false;
+    }
+    skip_spaces();
+    if (pos >= xml.size() || xml[pos] != '>') {
+      return false;
+    }
+    ++pos;
+    if (local_name(*name) == "Application") {
+      in_application = false;
+    }
+    return true;
+  }
+
+  bool start_tag() {
+    auto name{read_name()};
+    if (!name) {
+      return false;
+    }
+    auto local{local_name(*name)};
+    bool is_application = local == "Application";
+    bool is_visual = in_application && local == "VisualElements";
+    if (is_application) {
+      if (in_application) {
+        return false;
+      }
+      apps.emplace_back();
+      in_application = true;
+    }
+    while (true) {
+      skip_spaces();
+      if (pos >= xml.size()) {
+        return false;
+      }
+      if (xml[pos] == '>') {
+        ++pos;
+        return true;
+      }
+      if (xml[pos] == '/') {
+        if (pos + 1 >= xml.size() || xml[pos + 1] != '>') {
+          return false;
+        }
+        pos += 2;
+        if (is_application) {
+          in_application = false;
+        }
+        return true;
+      }
+      auto attr{read_name()};
+      if (!attr) {
+        return false;
+      }
+      skip_spaces();
+      if (pos >= xml.size() || xml[pos] != '=') {
+        return false;
+      }
+      ++pos;
+      skip_spaces();
+      if (pos >= xml.size() || (xml[pos] != '"' && xml[pos] != '\'')) {
+        return false;
+      }
+      auto close{xml.find(xml[pos], pos + 1)};
+      if (close == std::string_view::npos) {
+        return false;
+      }
+      auto value{xml.substr(pos + 1, close - pos - 1)};
+      if (value.find('<') != std::string_view::npos) {
+        return false;
+      }
+      pos = close + 1;
+      if (is_application && *attr == "Id") {
+        apps.back().id = value;
+      } else if (is_visual) {
+        if (*attr == "Square44x44Logo") {
+          apps.back().square44x44_logo = value;
+        } else if (*attr == "Square150x150Logo") {
+          apps.back().square150x150_logo = value;
+        } else if (*attr == "BackgroundColor") {
+          apps.back().background_color = value;
+        }
+      }
+    }
+  }
+
+  std::string_view xml;
+  std::size_t pos = 0;
+  std::vector<appx_application> apps;
+  bool in_application = false;
+};
+
+} // namespace
+
+std::optional<std::vector<appx_application>>
+scan_appx_manifest(const char *data, std::size_t size) {
+  if (size >= 2 && ((data[0] == '\xff' && data[1] == '\xfe') ||
+                    (data[0] == '\xfe' && data[1] == '\xff'))) {
+    return std::nullopt;
+  }
+  return manifest_scanner{std::string_view{data, size}}.scan();
+}
+
+std::optional<std::string> unescape_xml(std::string_view s) {
+  std::string out;
+  out.reserve(s.size());
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    if (is_space(s[i])) {
+      out.push_back(' ');
+      continue;
+    }
+    if (s[i] != '&') {
+      out.push_back(s[i]);
+      continue;
+    }
+    auto semi{s.find(';', i)};
+    if (semi == std::string_view::npos) {
+      return std::nullopt;
+    }
+    auto ref{s.substr(i + 1, semi - i - 1)};
+    i = semi;
+    if (ref == "lt") {
+      out.push_back('<');
+    } else if (ref == "gt") {
+      out.push_back('>');
+    } else if (ref == "amp") {
+      out.push_back('&');
+    } else if (ref == "quot") {
+      out.push_back('"');
+    } else if (ref == "apos") {
+      out.push_back('\'');
+    } else if (ref.size() > 1 && ref[0] == '#') {
+      bool hex = ref[1] == 'x';
+      auto digits{ref.substr(hex ? 2 : 1)};
+      if (digits.empty() || digits.size() > 8) {
+        return std::nullopt;
+      }
+      std::uint32_t cp = 0;
+      for (char ch : digits) {
+        std::uint32_t d;
+        if (ch >= '0' && ch <= '9') {
+          d = ch - '0';
+        } else if (hex && ch >= 'a' && ch <= 'f') {
+          d = ch - 'a' + 10;
+        } else if (hex && ch >= 'A' && ch <= 'F') {
+          d = ch - 'A' + 10;
+        } else {
+          return std::nullopt;
+        }
+        cp = cp * (hex ? 16 : 10) + d;
+      }
+      if (cp == 0 || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+        return std::nullopt;
+      }
+      append_utf8(out, cp);
+    } else {
+      return std::nullopt;
+    }
+  }
+  return out;
+}
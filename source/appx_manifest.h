@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct appx_application {
+  std::string_view id;
+  std::string_view square44x44_logo;
+  std::string_view square150x150_logo;
+  std::string_view background_color;
+};
+
+std::optional<std::vector<appx_application>>
+scan_appx_manifest(const char *data, std::size_t size);
+std::optional<std::string> unescape_xml(std::string_view s);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+class byte_reader {
+public:
+  byte_reader(const std::uint8_t *data, std::size_t size)
+      : data{data}, size{size} {}
+
+  bool in_bounds(std::size_t off, std::size_t len) const {
+    return off <= size && len <= size - off;
+  }
+
+  std::optional<std::uint8_t> u8(std::size_t off) const {
+    if (!in_bounds(off, 1)) {
+      return std::nullopt;
+    }
+    return data[off];
+  }
+
+  std::optional<std::uint16_t> u16(std::size_t off) const {
+    if (!in_bounds(off, 2)) {
+      return std::nullopt;
+    }
+    return std::uint16_t(data[off] | data[off + 1] << 8);
+  }
+
+  std::optional<std::uint32_t> u32(std::size_t off) const {
+    if (!in_bounds(off, 4)) {
+      return std::nullopt;
+    }
+    return std::uint32_t(data[off]) | std::uint32_t(data[off + 1]) << 8 |
+           std::uint32_t(data[off + 2]) << 16 |
+           std::uint32_t(data[off + 3]) << 24;
+  }
+
+  byte_reader sub(std::size_t off, std::size_t len) const {
+    if (!in_bounds(off, len)) {
+      return {data, 0};
+    }
+    return {data + off, len};
+  }
+
+  const std::uint8_t *data;
+  std::size_t size;
+};
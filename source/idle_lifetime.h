@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+
+template <class Clock = std::chrono::steady_clock> class idle_lifetime {
+public:
+  using clock = Clock;
+  using duration = typename clock::duration;
+  using time_point = typename clock::time_point;
+
+  explicit idle_lifetime(duration timeout) : timeout{timeout} {}
+
+  template <class Acquire> bool use(time_point now, Acquire &&acquire) {
+    last_use = now;
+    if (live) {
+      return false;
+    }
+    acquire();
+    live = true;
+    ++acquire_count;
+    return true;
+  }
+
+  void hold() { held = true; }
+
+  void unhold(time_point now) {
+    held = false;
+    last_use = now;
+  }
+
+  std::optional<time_point> due() const {
+    if (!live || held || timeout <= duration::zero()) {
+      return std::nullopt;
+    }
+    return last_use + timeout;
+  }
+
+  template <class Release> bool poll(time_point now, Release &&release) {
+    auto deadline{due()};
+    if (!deadline || now < *deadline) {
+      return false;
+    }
+    if (!release()) {
+      last_use = now;
+      return false;
+    }
+    live = false;
+    ++release_count;
+    return true;
+  }
+
+  void set_timeout(duration t) { timeout = t; }
+  bool alive() const { return live; }
+  std::size_t acquisitions() const { return acquire_count; }
+  std::size_t releases() const { return release_count; }
+
+private:
+  duration timeout;
+  time_point last_use{};
+  bool held = false;
+  bool live = false;
+  std::size_t acquire_count = 0;
+  std::size_t release_count = 0;
+};
@@ -1,5 +1,12 @@
 #include "pch.h"
 #include "resource.h"
+#include "appx_manifest.h"
+#include "idle_lifetime.h"
+#include "menu_model.h"
+#include "pe_icon.h"
+#include "pri_reader.h"
+#include "request_coalescer.h"
+#include "topmost_guard.h"
 using namespace winrt;
 
 constexpr int MAX_LOADSTR = 260;
@@ -7,14 +14,36 @@ constexpr UINT UM_TRAY = WM_USER + 1;
 constexpr UINT UM_THEMECHANGED = WM_USER + 2;
 constexpr UINT UM_SETMENUITEMICON = WM_USER + 3;
 constexpr UINT UM_MENU_CLOSED = WM_USER + 4;
+constexpr UINT_PTR TIMER_ENFORCE_TOPMOST = 1;
+constexpr UINT_PTR TIMER_IDLE = 2;
+constexpr UINT ICON_MESSAGE_TIMEOUT = 100;
 HINSTANCE hInst;
 HWND hWnd;
 WCHAR app_title[MAX_LOADSTR];
 WCHAR wnd_class[MAX_LOADSTR];
 
+Windows::UI::Xaml::Hosting::WindowsXamlManager xaml_manager{nullptr};
+Windows::UI::Xaml::Hosting::DesktopWindowXamlSource desktop_source{nullptr};
 Windows::UI::Xaml::Controls::TextBlock anchor{nullptr};
 Windows::UI::Xaml::Controls::MenuFlyout menu_flyout{nullptr};
+std::vector<Windows::UI::Xaml::Controls::MenuFlyoutItem> flyout_items;
+HMENU native_popup;
+std::vector<wil::unique_hicon> native_icons;
+menu_model<HWND> menu;
+bool native_menu;
+std::optional<std::chrono::steady_clock::time_point> menu_open_start;
+idle_lifetime<> idle_resources{std::chrono::seconds(60)};
 bool apps_use_dark_theme, system_uses_dark_theme;
+bool enforce_topmost;
+topmost_guard<HWND> pinned_windows{std::chrono::milliseconds(100),
+                                   std::chrono::milliseconds(500), 3,
+                                   std::chrono::seconds(10)};
+
+struct icon_request {
+  HWND wnd;
+  // Set when the window shows the icon of its executable.
+  std::optional<std::wstring> image;
+};
 
 void load_resource();
 void init_theme();
@@ -24,13 +53,24 @@ void init_tray(bool = false);
 void destroy_tray();
 void init_hotkey();
 void init_island();
+void init_menu_renderer();
+void init_enforce_topmost();
+void set_enforce_topmost(bool);
 void init_icon_thread();
+bool stop_icon_thread(std::chrono::milliseconds);
+void init_idle();
+void wake_idle_resources();
+void schedule_idle();
 void show_menu();
 void toggle_top(HWND wnd);
 std::vector<HWND> get_app_windows();
 HICON get_window_icon(HWND);
+std::optional<std::size_t> hash_icon_pixels(HICON);
 std::optional<std::wstring> get_uwp_icon_path(HWND);
+std::optional<std::wstring> get_exe_icon_path(const WCHAR *);
+std::pair<std::wstring, icon_request> get_icon_request(HWND);
 void write_icon(HICON, IStream *);
+wil::unique_hicon load_icon_file(const WCHAR *, int);
 int main_loop();
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
@@ -50,8 +90,9 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
   make_window();
   init_tray();
   init_hotkey();
-  init_island();
-  init_icon_thread();
+  init_menu_renderer();
+  init_idle();
+  init_enforce_topmost();
   return main_loop();
 }
 
@@ -136,23 +177,50 @@ void notify_error(UINT title_id, UINT info_id) {
 
 void init_hotkey() { RegisterHotKey(hWnd, 0, MOD_CONTROL | MOD_ALT, 0x54); }
 
+PROCESS_MEMORY_COUNTERS_EX get_memory_counters() {
+  PROCESS_MEMORY_COUNTERS_EX pmc{};
+  pmc.cb = sizeof(pmc);
+  THROW_IF_WIN32_BOOL_FALSE(GetProcessMemoryInfo(
+      GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&pmc, sizeof(pmc)));
+  return pmc;
+}
+
+void log_menu_opened(const WCHAR *renderer) {
+  if (!menu_open_start) {
+    return;
+  }
+  std::chrono::duration<double, std::milli> elapsed{
+      std::chrono::steady_clock::now() - *menu_open_start};
+  menu_open_start.reset();
+  auto pmc{get_memory_counters()};
+  WCHAR stats[MAX_LOADSTR];
+  THROW_IF_FAILED(StringCchPrintfW(
+      stats, MAX_LOADSTR,
+      L"%ws: %ws menu opened in %.1f ms, "
+      L"working set %zu KB, private bytes %zu KB\n",
+      app_title, renderer, elapsed.count(), pmc.WorkingSetSize / 1024,
+      pmc.PrivateUsage / 1024));
+  OutputDebugStringW(stats);
+}
+
 void create_menu_flyout() {
   menu_flyout = Windows::UI::Xaml::Controls::MenuFlyout{};
   menu_flyout.Placement(Windows::UI::Xaml::Controls::Primitives::
                             FlyoutPlacementMode::TopEdgeAlignedLeft);
   Windows::UI::Xaml::Controls::Primitives::FlyoutBase::SetAttachedFlyout(
       anchor, menu_flyout);
+  menu_flyout.Opened(
+      [](const auto &, const auto &) { log_menu_opened(L"XAML"); });
   menu_flyout.Closed([](const auto &, const auto &) {
     SendNotifyMessageW(hWnd, UM_MENU_CLOSED, 0, 0);
   });
 }
 
 void init_island() {
-  static Windows::UI::Xaml::Hosting::WindowsXamlManager xaml_manager{nullptr};
-  static Windows::UI::Xaml::Hosting::DesktopWindowXamlSource desktop_source{
-      nullptr};
-  xaml_manager = Windows::UI::Xaml::Hosting::WindowsXamlManager::
-      InitializeForCurrentThread();
+  if (!xaml_manager) {
+    xaml_manager = Windows::UI::Xaml::Hosting::WindowsXamlManager::
+        InitializeForCurrentThread();
+  }
   desktop_source = Windows::UI::Xaml::Hosting::DesktopWindowXamlSource{};
   auto interop = desktop_source.as<IDesktopWindowXamlSourceNative>();
   THROW_IF_FAILED(interop->AttachToWindow(hWnd));
@@ -164,6 +232,18 @@ void init_island() {
   create_menu_flyout();
 }
 
+// XAML stays initialized for the thread: only the island and the menu are
+// released, as closing and re-initializing the framework is not relied on.
+void release_island() {
+  flyout_items.clear();
+  menu_flyout = nullptr;
+  anchor = nullptr;
+  if (desktop_source) {
+    desktop_source.Close();
+    desktop_source = nullptr;
+  }
+}
+
 constexpr WCHAR reg_theme_path[] =
     L"SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Themes\\Personalize";
 
@@ -217,106 +297,449 @@ bool is_window_topmost(HWND wnd) {
   return GetWindowLongW(wnd, GWL_EXSTYLE) & WS_EX_TOPMOST;
 }
 
-std::queue<std::pair<HWND, Windows::UI::Xaml::Controls::MenuFlyoutItem>> itq;
-std::queue<std::pair<std::wstring, Windows::UI::Xaml::Controls::MenuFlyoutItem>>
-    itbq;
+std::queue<std::pair<HWND, menu_slot>> itq;
+std::queue<std::pair<std::wstring, menu_slot>> itbq;
 std::condition_variable itcv;
 std::mutex itmutex;
 
-void show_menu(int x, int y) {
-  THROW_IF_WIN32_BOOL_FALSE(
-      SetWindowPos(hWnd, HWND_TOPMOST, x, y, 0, 0, SWP_NOSIZE));
-  if (!SetForegroundWindow(hWnd)) {
+void run_menu_command(std::size_t index) {
+  auto entry{menu.find(menu.slot(index))};
+  if (!entry) {
     return;
   }
-  WCHAR exit_str[MAX_LOADSTR];
+  switch (entry->kind) {
+  case menu_entry_kind::window:
+    toggle_top(entry->wnd);
+    break;
+  case menu_entry_kind::enforce_topmost:
+    set_enforce_topmost(!enforce_topmost);
+    break;
+  case menu_entry_kind::exit:
+    DestroyWindow(hWnd);
+    break;
+  default:
+    break;
+  }
+}
+
+void build_menu() {
+  WCHAR exit_str[MAX_LOADSTR], enforce_str[MAX_LOADSTR];
   THROW_LAST_ERROR_IF(LoadStringW(hInst, IDS_EXIT, exit_str, MAX_LOADSTR) == 0);
+  THROW_LAST_ERROR_IF(LoadStringW(hInst, IDS_ENFORCE_TOPMOST, enforce_str,
+                                  MAX_LOADSTR) == 0);
+  auto slots{menu.build(
+      get_app_windows(),
+      [](HWND wnd) {
+        WCHAR wnd_text[MAX_LOADSTR];
+        wnd_text[GetWindowTextW(wnd, wnd_text, MAX_LOADSTR)] = 0;
+        return std::pair{std::wstring{wnd_text}, is_window_topmost(wnd)};
+      },
+      enforce_str, enforce_topmost, exit_str)};
+  std::scoped_lock lck{itmutex};
+  for (const auto &request : slots) {
+    itq.push(request);
+  }
+  itcv.notify_one();
+}
+
+void set_xaml_menu_icon(const Windows::UI::Xaml::Controls::MenuFlyoutItem &item,
+                        const std::wstring &uri) {
+  if (!uri.empty()) {
+    auto icon{item.Icon().as<Windows::UI::Xaml::Controls::BitmapIcon>()};
+    icon.UriSource(Windows::Foundation::Uri(uri));
+  } else {
+    Windows::UI::Xaml::Controls::FontIcon icon;
+    icon.FontFamily(
+        Windows::UI::Xaml::Media::FontFamily(L"Segoe MDL2 Assets"));
+    icon.Glyph(L"\uE8BE");
+    Windows::UI::Color green;
+    green.R = green.B = 0;
+    green.G = 128;
+    green.A = 255;
+    icon.Foreground(Windows::UI::Xaml::Media::SolidColorBrush(green));
+    item.Icon(icon);
+  }
+}
+
+void show_xaml_menu() {
   auto menu_items{menu_flyout.Items()};
   menu_items.Clear();
-  auto wnds{get_app_windows()};
-  {
-    std::scoped_lock lck{itmutex};
-    for (auto wnd : wnds) {
-      WCHAR wnd_text[MAX_LOADSTR];
-      wnd_text[GetWindowTextW(wnd, wnd_text, MAX_LOADSTR)] = 0;
-      Windows::UI::Xaml::Controls::ToggleMenuFlyoutItem item;
+  flyout_items.clear();
+  const auto &entries{menu.entries()};
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const auto &entry{entries[i]};
+    if (entry.kind == menu_entry_kind::separator) {
+      menu_items.Append(Windows::UI::Xaml::Controls::MenuFlyoutSeparator{});
+      flyout_items.push_back(nullptr);
+      continue;
+    }
+    Windows::UI::Xaml::Controls::MenuFlyoutItem item{nullptr};
+    if (entry.kind == menu_entry_kind::exit) {
+      item = Windows::UI::Xaml::Controls::MenuFlyoutItem{};
+    } else {
+      Windows::UI::Xaml::Controls::ToggleMenuFlyoutItem toggle_item;
+      toggle_item.IsChecked(entry.checked);
+      item = toggle_item;
+    }
+    item.Text(entry.text);
+    if (entry.kind == menu_entry_kind::window) {
       Windows::UI::Xaml::Controls::BitmapIcon icon;
       icon.ShowAsMonochrome(false);
-      item.Text(wnd_text);
       item.Icon(icon);
-      item.IsChecked(is_window_topmost(wnd));
-      item.Click([wnd](const auto &, const auto &) { toggle_top(wnd); });
-      menu_items.Append(item);
-
-      itq.push({wnd, std::move(item)});
+      if (entry.icon) {
+        set_xaml_menu_icon(item, *entry.icon);
+      }
     }
-    itcv.notify_one();
+    item.Click([i](const auto &, const auto &) { run_menu_command(i); });
+    menu_items.Append(item);
+    flyout_items.push_back(std::move(item));
   }
-  if (!wnds.empty()) {
-    menu_items.Append(Windows::UI::Xaml::Controls::MenuFlyoutSeparator{});
-  }
-  Windows::UI::Xaml::Controls::MenuFlyoutItem exit_item;
-  exit_item.Text(exit_str);
-  exit_item.Click([](const auto &, const auto &) { DestroyWindow(hWnd); });
-  menu_items.Append(exit_item);
   Windows::UI::Xaml::Controls::Primitives::FlyoutBase::ShowAttachedFlyout(
       anchor);
 }
 
-std::optional<std::wstring> get_window_icon_uri(HWND wnd) {
+void set_native_menu_icon(std::size_t index, const std::wstring &uri) {
+  if (index >= native_icons.size() || uri.empty()) {
+    return;
+  }
+  native_icons[index] = load_icon_file(uri.c_str(), get_iconsm_metric());
+  if (!native_popup) {
+    return;
+  }
+  EnumThreadWindows(
+      GetCurrentThreadId(),
+      [](HWND wnd, LPARAM) -> BOOL {
+        WCHAR cls[MAX_LOADSTR];
+        cls[GetClassNameW(wnd, cls, MAX_LOADSTR)] = 0;
+        if (wcscmp(cls, L"#32768") == 0 &&
+            HMENU(SendMessageW(wnd, MN_GETHMENU, 0, 0)) == native_popup) {
+          InvalidateRect(wnd, nullptr, FALSE);
+        }
+        return TRUE;
+      },
+      0);
+}
+
+std::optional<std::size_t> show_native_menu(int x, int y) {
+  wil::unique_hmenu popup{CreatePopupMenu()};
+  THROW_LAST_ERROR_IF(!popup);
+  const auto &entries{menu.entries()};
+  native_icons.clear();
+  native_icons.resize(entries.size());
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    const auto &entry{entries[i]};
+    MENUITEMINFOW mii{};
+    mii.cbSize = sizeof(mii);
+    std::wstring text;
+    if (entry.kind == menu_entry_kind::separator) {
+      mii.fMask = MIIM_FTYPE;
+      mii.fType = MFT_SEPARATOR;
+    } else {
+      for (auto ch : entry.text) {
+        text.append(ch == L'&' ? 2 : 1, ch);
+      }
+      mii.fMask = MIIM_ID | MIIM_STRING | MIIM_STATE;
+      mii.wID = UINT(i + 1);
+      mii.dwTypeData = text.data();
+      mii.fState = entry.checked ? MFS_CHECKED : MFS_UNCHECKED;
+    }
+    if (entry.kind == menu_entry_kind::window) {
+      mii.fMask |= MIIM_BITMAP;
+      mii.hbmpItem = HBMMENU_CALLBACK;
+      if (entry.icon) {
+        set_native_menu_icon(i, *entry.icon);
+      }
+    }
+    THROW_IF_WIN32_BOOL_FALSE(
+        InsertMenuItemW(popup.get(), UINT(i), TRUE, &mii));
+  }
+  native_popup = popup.get();
+  auto cmd = TrackPopupMenuEx(popup.get(),
+                              TPM_RETURNCMD | TPM_RIGHTBUTTON |
+                                  TPM_LEFTALIGN | TPM_BOTTOMALIGN,
+                              x, y, hWnd, nullptr);
+  native_popup = nullptr;
+  native_icons.clear();
+  PostMessageW(hWnd, WM_NULL, 0, 0);
+  if (cmd <= 0) {
+    return std::nullopt;
+  }
+  return std::size_t(cmd) - 1;
+}
+
+void show_menu(int x, int y) {
+  menu_open_start = std::chrono::steady_clock::now();
+  THROW_IF_WIN32_BOOL_FALSE(
+      SetWindowPos(hWnd, HWND_TOPMOST, x, y, 0, 0, SWP_NOSIZE));
+  if (!SetForegroundWindow(hWnd)) {
+    return;
+  }
+  wake_idle_resources();
+  build_menu();
+  idle_resources.hold();
+  if (native_menu) {
+    auto command{show_native_menu(x, y)};
+    idle_resources.unhold(std::chrono::steady_clock::now());
+    schedule_idle();
+    if (command) {
+      run_menu_command(*command);
+    }
+  } else {
+    show_xaml_menu();
+  }
+}
+
+// Writes to a unique name and moves the result into place, so a failed write
+// never leaves a truncated file behind under path. An existing file is kept.
+template <class Write> void write_temp_file(const WCHAR *path, Write &&write) {
+  if (GetFileAttributesW(path) != INVALID_FILE_ATTRIBUTES) {
+    return;
+  }
+  WCHAR temp_path[MAX_LOADSTR], partial[MAX_PATH];
+  THROW_LAST_ERROR_IF(GetTempPathW(MAX_LOADSTR, temp_path) == 0);
+  THROW_LAST_ERROR_IF(GetTempFileNameW(temp_path, L"ptt", 0, partial) == 0);
+  auto remove{wil::scope_exit([&] { DeleteFileW(partial); })};
+  {
+    wil::com_ptr<IStream> stream;
+    THROW_IF_FAILED(SHCreateStreamOnFileEx(
+        partial, STGM_READWRITE | STGM_SHARE_EXCLUSIVE | STGM_CREATE,
+        FILE_ATTRIBUTE_NORMAL, FALSE, nullptr, &stream));
+    write(stream.get());
+  }
+  if (!MoveFileExW(partial, path, 0)) {
+    THROW_LAST_ERROR_IF(GetLastError() != ERROR_ALREADY_EXISTS);
+  }
+}
+
+std::optional<std::wstring> get_window_icon_uri(const icon_request &request) {
+  auto wnd{request.wnd};
   if (!IsWindow(wnd)) {
     return std::nullopt;
   }
-  auto uwp_icon_path{get_uwp_icon_path(wnd)};
-  if (uwp_icon_path) {
-    return *uwp_icon_path;
+  if (!request.image) {
+    auto uwp_icon_path{get_uwp_icon_path(wnd)};
+    if (uwp_icon_path) {
+      return *uwp_icon_path;
+    }
+  }
+  auto exe_icon_path{request.image ? get_exe_icon_path(request.image->c_str())
+                                   : std::nullopt};
+  if (exe_icon_path) {
+    return *exe_icon_path;
   } else {
     auto hicon{get_window_icon(wnd)};
     if (hicon) {
       WCHAR temp_path[MAX_LOADSTR], temp_file[MAX_LOADSTR];
       THROW_LAST_ERROR_IF(GetTempPathW(MAX_LOADSTR, temp_path) == 0);
-      THROW_IF_FAILED(StringCchPrintfW(temp_file, MAX_LOADSTR, L"%ws%p.png",
-                                       temp_path, hicon));
-      {
-        wil::com_ptr<IStream> stream;
-        auto hr = SHCreateStreamOnFileEx(
-            temp_file, STGM_READWRITE | STGM_SHARE_EXCLUSIVE | STGM_FAILIFTHERE,
-            FILE_ATTRIBUTE_NORMAL, TRUE, nullptr, &stream);
-        if (SUCCEEDED(hr)) {
-          write_icon(hicon, stream.get());
-        } else if ((hr & 0xffff) != ERROR_FILE_EXISTS) {
-          THROW_HR(hr);
-        }
-      }
+      THROW_IF_FAILED(StringCchPrintfW(
+          temp_file, MAX_LOADSTR, L"%ws%zx.png", temp_path,
+          hash_icon_pixels(hicon).value_or(std::size_t(hicon))));
+      write_temp_file(temp_file,
+                      [&](IStream *stream) { write_icon(hicon, stream); });
       return temp_file;
     }
   }
   return std::nullopt;
 }
 
+std::thread icon_thread;
+std::condition_variable itdone;
+bool itstop, itrunning;
+
 void init_icon_thread() {
-  std::thread{[] {
-    while (true) {
-      std::unique_lock lck{itmutex};
-      itcv.wait(lck);
+  itrunning = true;
+  icon_thread = std::thread{[] {
+    request_coalescer<std::wstring, icon_request, menu_slot> coalescer;
+    std::size_t generation = 0;
+    auto take_requests{[] {
+      std::vector<std::pair<HWND, menu_slot>> requests;
       while (!itq.empty()) {
-        auto wnd{itq.front().first};
-        auto item{std::move(itq.front().second)};
+        requests.push_back(std::move(itq.front()));
         itq.pop();
-        auto uri{get_window_icon_uri(wnd)};
-        if (uri) {
-          itbq.push({std::move(*uri), std::move(item)});
+      }
+      return requests;
+    }};
+    auto enqueue{[&](const std::vector<std::pair<HWND, menu_slot>> &requests) {
+      for (const auto &[wnd, slot] : requests) {
+        if (slot.generation < generation) {
+          continue;
         }
+        if (slot.generation > generation) {
+          // The menu was rebuilt; icons for the old one are never shown.
+          generation = slot.generation;
+          coalescer.prune([&](const menu_slot &waiter) {
+            return waiter.generation < generation;
+          });
+        }
+        auto [key, request]{get_icon_request(wnd)};
+        coalescer.enqueue(key, request, slot);
+      }
+    }};
+    while (true) {
+      std::vector<std::pair<HWND, menu_slot>> requests;
+      {
+        std::unique_lock lck{itmutex};
+        if (coalescer.empty()) {
+          itcv.wait(lck, [] { return !itq.empty() || itstop; });
+        }
+        if (itstop) {
+          itrunning = false;
+          itdone.notify_one();
+          return;
+        }
+        requests = take_requests();
+      }
+      enqueue(requests);
+      auto request{coalescer.next()};
+      if (!request) {
+        continue;
+      }
+      auto uri{get_window_icon_uri(request->second)};
+      {
+        std::scoped_lock lck{itmutex};
+        requests = take_requests();
+      }
+      // Requests that arrived while resolving join the finished call.
+      enqueue(requests);
+      {
+        std::scoped_lock lck{itmutex};
+        for (const auto &slot : coalescer.complete(request->first)) {
+          if (uri) {
+            itbq.push({*uri, slot});
+          }
+        }
+      }
+      if (coalescer.empty()) {
+        WCHAR stats[MAX_LOADSTR];
+        THROW_IF_FAILED(StringCchPrintfW(stats, MAX_LOADSTR,
+                                         L"%ws: %zu icon requests, "
+                                         L"%zu resolver calls\n",
+                                         app_title, coalescer.requests(),
+                                         coalescer.calls()));
+        OutputDebugStringW(stats);
       }
       THROW_IF_WIN32_BOOL_FALSE(
           SendNotifyMessage(hWnd, UM_SETMENUITEMICON, 0, 0));
     }
-  }}.detach();
+  }};
+}
+
+bool stop_icon_thread(std::chrono::milliseconds timeout) {
+  if (!icon_thread.joinable()) {
+    return true;
+  }
+  std::unique_lock lck{itmutex};
+  itstop = true;
+  itcv.notify_one();
+  bool stopped = itdone.wait_for(lck, timeout, [] { return !itrunning; });
+  itstop = false;
+  if (!stopped) {
+    return false;
+  }
+  itq = {};
+  itbq = {};
+  lck.unlock();
+  icon_thread.join();
+  return true;
+}
+
+constexpr WCHAR reg_settings_path[] = L"SOFTWARE\\PinToTop";
+
+void schedule_enforce_topmost() {
+  auto due{pinned_windows.due()};
+  if (!due) {
+    KillTimer(hWnd, TIMER_ENFORCE_TOPMOST);
+    return;
+  }
+  auto delay{std::chrono::ceil<std::chrono::milliseconds>(
+      *due - std::chrono::steady_clock::now())};
+  THROW_LAST_ERROR_IF(SetTimer(hWnd, TIMER_ENFORCE_TOPMOST,
+                               UINT(std::max<long long>(delay.count(),
+                                                        USER_TIMER_MINIMUM)),
+                               nullptr) == 0);
+}
+
+void CALLBACK on_zorder_event(HWINEVENTHOOK, DWORD, HWND, LONG, LONG, DWORD,
+                              DWORD) {
+  if (pinned_windows.empty()) {
+    return;
+  }
+  auto scheduled{pinned_windows.due()};
+  pinned_windows.notify(std::chrono::steady_clock::now());
+  if (!scheduled || *pinned_windows.due() < *scheduled) {
+    schedule_enforce_topmost();
+  }
+}
+
+void enforce_topmost_now() {
+  auto lost{pinned_windows.poll(std::chrono::steady_clock::now(), [](HWND wnd) {
+    if (!IsWindow(wnd)) {
+      return pin_state::gone;
+    }
+    return is_window_topmost(wnd) ? pin_state::topmost : pin_state::lost;
+  })};
+  for (auto wnd : lost) {
+    SetWindowPos(wnd, HWND_TOPMOST, 0, 0, 0, 0,
+                 SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE |
+                     SWP_ASYNCWINDOWPOS);
+  }
+  schedule_enforce_topmost();
+}
+
+void set_enforce_topmost(bool enable) {
+  static wil::unique_hwineventhook foreground_hook, reorder_hook;
+  enforce_topmost = enable;
+  if (enable) {
+    foreground_hook.reset(SetWinEventHook(
+        EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, nullptr,
+        on_zorder_event, 0, 0,
+        WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS));
+    THROW_LAST_ERROR_IF(!foreground_hook);
+    reorder_hook.reset(SetWinEventHook(
+        EVENT_OBJECT_REORDER, EVENT_OBJECT_REORDER, nullptr, on_zorder_event,
+        0, 0, WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS));
+    THROW_LAST_ERROR_IF(!reorder_hook);
+  } else {
+    foreground_hook.reset();
+    reorder_hook.reset();
+    KillTimer(hWnd, TIMER_ENFORCE_TOPMOST);
+  }
+  DWORD value = enable;
+  THROW_IF_WIN32_ERROR(RegSetKeyValueW(HKEY_CURRENT_USER, reg_settings_path,
+                                       L"EnforceTopmost", REG_DWORD, &value,
+                                       sizeof(value)));
+}
+
+void init_enforce_topmost() {
+  DWORD value = 0;
+  DWORD buf_len = sizeof(DWORD);
+  if (RegGetValueW(HKEY_CURRENT_USER, reg_settings_path, L"EnforceTopmost",
+                   RRF_RT_REG_DWORD, nullptr, &value, &buf_len) ==
+          ERROR_SUCCESS &&
+      value) {
+    set_enforce_topmost(true);
+  }
+}
+
+void init_menu_renderer() {
+  DWORD value = 0;
+  DWORD buf_len = sizeof(DWORD);
+  native_menu = RegGetValueW(HKEY_CURRENT_USER, reg_settings_path,
+                             L"NativeMenu", RRF_RT_REG_DWORD, nullptr, &value,
+                             &buf_len) == ERROR_SUCCESS &&
+                value;
 }
 
 void toggle_top(HWND wnd) {
-  if (!SetWindowPos(wnd, is_window_topmost(wnd) ? HWND_NOTOPMOST : HWND_TOPMOST,
-                    0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE)) {
+  bool pin = !is_window_topmost(wnd);
+  if (SetWindowPos(wnd, pin ? HWND_TOPMOST : HWND_NOTOPMOST, 0, 0, 0, 0,
+                   SWP_NOMOVE | SWP_NOSIZE)) {
+    if (pin) {
+      pinned_windows.pin(wnd);
+    } else {
+      pinned_windows.unpin(wnd);
+    }
+  } else {
     DWORD err = GetLastError();
     switch (err) {
     case 5:
@@ -332,13 +755,30 @@ void toggle_top(HWND wnd) {
   }
 }
 
-bool is_app_window(HWND wnd) {
-  static IVirtualDesktopManager *vdm;
-  if (!vdm) {
-    THROW_IF_FAILED(CoCreateInstance(
-        __uuidof(VirtualDesktopManager), nullptr, CLSCTX_INPROC_SERVER,
-        __uuidof(IVirtualDesktopManager), (void **)&vdm));
+std::mutex com_factory_mutex;
+wil::com_ptr<IVirtualDesktopManager> vd_manager;
+wil::com_ptr<IAppxFactory> appx_factory;
+wil::com_ptr<IWICImagingFactory> wic_factory;
+
+template <class T>
+T *get_com_factory(wil::com_ptr<T> &factory, REFCLSID clsid) {
+  std::scoped_lock lck{com_factory_mutex};
+  if (!factory) {
+    THROW_IF_FAILED(CoCreateInstance(clsid, nullptr, CLSCTX_INPROC_SERVER,
+                                     __uuidof(T), factory.put_void()));
   }
+  return factory.get();
+}
+
+void release_com_factories() {
+  std::scoped_lock lck{com_factory_mutex};
+  vd_manager.reset();
+  appx_factory.reset();
+  wic_factory.reset();
+}
+
+bool is_app_window(HWND wnd) {
+  auto vdm{get_com_factory(vd_manager, __uuidof(VirtualDesktopManager))};
   LONG ex_sty = GetWindowLongW(wnd, GWL_EXSTYLE);
   WCHAR wnd_class[MAX_LOADSTR];
   wnd_class[RealGetWindowClassW(wnd, wnd_class, MAX_LOADSTR)] = 0;
@@ -371,14 +811,192 @@ HICON get_window_icon(HWND wnd) {
   if (icon) {
     return icon;
   }
-  icon = HICON(SendMessageW(wnd, WM_GETICON, ICON_SMALL2, 0));
-  if (icon) {
-    return icon;
+  DWORD_PTR result;
+  if (SendMessageTimeoutW(wnd, WM_GETICON, ICON_SMALL2, 0,
+                          SMTO_ABORTIFHUNG | SMTO_BLOCK, ICON_MESSAGE_TIMEOUT,
+                          &result) &&
+      result) {
+    return HICON(result);
   }
   icon = HICON(GetClassLongPtrW(wnd, -14));
   return icon;
 }
 
+std::optional<std::size_t> hash_icon_pixels(HICON icon) {
+  ICONINFO ii;
+  if (!GetIconInfo(icon, &ii)) {
+    return std::nullopt;
+  }
+  wil::unique_hbitmap color{ii.hbmColor}, mask{ii.hbmMask};
+  wil::unique_hdc dc{CreateCompatibleDC(nullptr)};
+  if (!dc) {
+    return std::nullopt;
+  }
+  std::string bits;
+  for (auto bitmap : {color.get(), mask.get()}) {
+    BITMAP bm;
+    if (!bitmap || !GetObjectW(bitmap, sizeof(bm), &bm)) {
+      continue;
+    }
+    BITMAPINFO bi{};
+    bi.bmiHeader.biSize = sizeof(bi.bmiHeader);
+    bi.bmiHeader.biWidth = bm.bmWidth;
+    bi.bmiHeader.biHeight = -bm.bmHeight;
+    bi.bmiHeader.biPlanes = 1;
+    bi.bmiHeader.biBitCount = 32;
+    bi.bmiHeader.biCompression = BI_RGB;
+    auto offset{bits.size()};
+    bits.resize(offset + size_t(bm.bmWidth) * size_t(bm.bmHeight) * 4);
+    if (!GetDIBits(dc.get(), bitmap, 0, UINT(bm.bmHeight), &bits[offset], &bi,
+                   DIB_RGB_COLORS)) {
+      return std::nullopt;
+    }
+  }
+  if (bits.empty()) {
+    return std::nullopt;
+  }
+  return std::hash<std::string>{}(bits);
+}
+
+struct mapped_file {
+  wil::unique_hfile file;
+  wil::unique_handle mapping;
+  wil::unique_mapview_ptr<std::uint8_t> view;
+  size_t size;
+};
+
+std::optional<mapped_file> map_file(const WCHAR *path) {
+  mapped_file mf;
+  // Paths come from other processes, so System32 must not be redirected to
+  // SysWOW64 when running as a 32-bit process on 64-bit Windows.
+  PVOID redirection;
+  BOOL redirected = Wow64DisableWow64FsRedirection(&redirection);
+  mf.file.reset(CreateFileW(path, GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                FILE_SHARE_DELETE,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr));
+  if (redirected) {
+    Wow64RevertWow64FsRedirection(redirection);
+  }
+  if (!mf.file) {
+    return std::nullopt;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(mf.file.get(), &size) || size.QuadPart == 0 ||
+      ULONGLONG(size.QuadPart) > SIZE_MAX) {
+    return std::nullopt;
+  }
+  mf.mapping.reset(CreateFileMappingW(mf.file.get(), nullptr, PAGE_READONLY,
+                                      0, 0, nullptr));
+  if (!mf.mapping) {
+    return std::nullopt;
+  }
+  mf.view.reset(static_cast<std::uint8_t *>(
+      MapViewOfFile(mf.mapping.get(), FILE_MAP_READ, 0, 0, 0)));
+  if (!mf.view) {
+    return std::nullopt;
+  }
+  mf.size = size_t(size.QuadPart);
+  return mf;
+}
+
+bool is_wider_process(HANDLE p) {
+  USHORT self, target, native;
+  return IsWow64Process2(GetCurrentProcess(), &self, &native) &&
+         self != IMAGE_FILE_MACHINE_UNKNOWN &&
+         IsWow64Process2(p, &target, &native) &&
+         target == IMAGE_FILE_MACHINE_UNKNOWN;
+}
+
+bool is_image_class_icon(HWND wnd, const WCHAR *exename) {
+  for (int index : {GCLP_HICONSM, GCLP_HICON}) {
+    auto icon{HICON(GetClassLongPtrW(wnd, index))};
+    ICONINFOEXW ii{};
+    ii.cbSize = sizeof(ii);
+    if (!icon || !GetIconInfoExW(icon, &ii)) {
+      continue;
+    }
+    wil::unique_hbitmap color{ii.hbmColor}, mask{ii.hbmMask};
+    if (_wcsicmp(ii.szModName, exename) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool is_image_window_icon(HWND wnd, DWORD pid, const WCHAR *exename) {
+  wil::unique_handle p{
+      OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, pid)};
+  if (!p) {
+    return false;
+  }
+  // Module handles of a 64-bit process are truncated in a 32-bit one and
+  // its modules cannot be enumerated from there; ask where the class icon
+  // was loaded from instead.
+  if (is_wider_process(p.get())) {
+    if (!is_image_class_icon(wnd, exename)) {
+      return false;
+    }
+  } else {
+    HMODULE main_module;
+    DWORD needed;
+    if (!EnumProcessModulesEx(p.get(), &main_module, sizeof(main_module),
+                              &needed, LIST_MODULES_ALL) ||
+        HMODULE(GetClassLongPtrW(wnd, GCLP_HMODULE)) != main_module) {
+      return false;
+    }
+  }
+  for (WPARAM type : {ICON_SMALL, ICON_BIG}) {
+    DWORD_PTR icon;
+    if (!SendMessageTimeoutW(wnd, WM_GETICON, type, 0,
+                             SMTO_ABORTIFHUNG | SMTO_BLOCK,
+                             ICON_MESSAGE_TIMEOUT, &icon) ||
+        icon) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::unordered_map<std::wstring, std::optional<std::wstring>> exe_icon_cache;
+
+std::optional<std::wstring> get_exe_icon_path(const WCHAR *exename) {
+  auto image{map_file(exename)};
+  if (!image) {
+    return std::nullopt;
+  }
+  const int cx = get_iconsm_metric();
+  auto version{find_pe_file_version(image->view.get(), image->size)};
+  WCHAR key[MAX_LOADSTR + 64];
+  THROW_IF_FAILED(StringCchPrintfW(key, MAX_LOADSTR + 64, L"%ws|%llx|%d",
+                                   exename, version.value_or(0), cx));
+  auto cached{exe_icon_cache.find(key)};
+  if (cached != exe_icon_cache.end()) {
+    return cached->second;
+  }
+  auto &result{exe_icon_cache[key]};
+  auto icon{find_pe_icon(image->view.get(), image->size, cx)};
+  if (!icon) {
+    return result;
+  }
+  WCHAR temp_path[MAX_LOADSTR], temp_file[MAX_LOADSTR];
+  THROW_LAST_ERROR_IF(GetTempPathW(MAX_LOADSTR, temp_path) == 0);
+  THROW_IF_FAILED(StringCchPrintfW(
+      temp_file, MAX_LOADSTR, L"%ws%zx.%ws", temp_path,
+      std::hash<std::wstring_view>{}(key), icon->is_png ? L"png" : L"ico"));
+  write_temp_file(temp_file, [&](IStream *stream) {
+    if (icon->is_png) {
+      THROW_IF_FAILED(stream->Write(icon->data, ULONG(icon->size), nullptr));
+    } else {
+      auto ico{make_ico(*icon)};
+      THROW_IF_FAILED(stream->Write(ico.data(), ULONG(ico.size()), nullptr));
+    }
+  });
+  result = temp_file;
+  return result;
+}
+
 bool parse_modifiers(std::wstring_view s,
                      std::unordered_map<std::wstring, std::wstring> &mod) {
   bool finished = false;
@@ -406,20 +1024,12 @@ bool parse_modifiers(std::wstring_view s,
   return true;
 }
 
-std::optional<std::wstring> get_uwp_icon_path(HWND wnd) {
-  DWORD pid;
-  GetWindowThreadProcessId(wnd, &pid);
-  wil::unique_handle p{
-      OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid)};
-  THROW_LAST_ERROR_IF_NULL(p);
-  WCHAR exename[MAX_LOADSTR];
-  DWORD exelen = MAX_LOADSTR;
-  THROW_IF_WIN32_BOOL_FALSE(
-      QueryFullProcessImageNameW(p.get(), 0, exename, &exelen));
-  if (_wcsicmp(exename, L"C:\\Windows\\System32\\ApplicationFrameHost.exe") !=
-      0) {
-    return std::nullopt;
-  }
+bool is_frame_host(const WCHAR *exename) {
+  return _wcsicmp(exename,
+                  L"C:\\Windows\\System32\\ApplicationFrameHost.exe") == 0;
+}
+
+DWORD get_frame_host_real_pid(HWND wnd, DWORD pid) {
   DWORD real_pid = pid;
   EnumChildWindows(
       wnd,
@@ -435,50 +1045,87 @@ std::optional<std::wstring> get_uwp_icon_path(HWND wnd) {
         }
       },
       LPARAM(&real_pid));
-  if (real_pid == pid) {
-    return L"";
+  return real_pid;
+}
+
+std::pair<std::wstring, icon_request> get_icon_request(HWND wnd) {
+  WCHAR key[MAX_LOADSTR + 32];
+  DWORD pid;
+  GetWindowThreadProcessId(wnd, &pid);
+  wil::unique_handle p{
+      OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid)};
+  WCHAR exename[MAX_LOADSTR];
+  DWORD exelen = MAX_LOADSTR;
+  if (p && QueryFullProcessImageNameW(p.get(), 0, exename, &exelen)) {
+    if (!is_frame_host(exename)) {
+      if (is_image_window_icon(wnd, pid, exename)) {
+        return {std::wstring{L"exe:"} + exename, {wnd, exename}};
+      }
+      auto hicon{get_window_icon(wnd)};
+      auto hash{hicon ? hash_icon_pixels(hicon) : std::nullopt};
+      if (hash) {
+        THROW_IF_FAILED(
+            StringCchPrintfW(key, MAX_LOADSTR + 32, L"icon:%zx", *hash));
+        return {key, {wnd}};
+      }
+    } else {
+      DWORD real_pid = get_frame_host_real_pid(wnd, pid);
+      if (real_pid == pid) {
+        return {L"uwp:", {wnd}};
+      }
+      p.reset(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, real_pid));
+      WCHAR full_name[PACKAGE_FULL_NAME_MAX_LENGTH + 1];
+      UINT32 full_name_len = PACKAGE_FULL_NAME_MAX_LENGTH + 1;
+      if (p && GetPackageFullName(p.get(), &full_name_len, full_name) ==
+                   ERROR_SUCCESS) {
+        return {std::wstring{L"uwp:"} + full_name, {wnd}};
+      }
+    }
   }
-  p.reset(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, real_pid));
-  THROW_LAST_ERROR_IF_NULL(p);
-  UINT32 buflen = 0;
-  LONG r = GetPackageId(p.get(), &buflen, nullptr);
-  std::vector<BYTE> pkg_id_buf;
-  if (r == ERROR_INSUFFICIENT_BUFFER) {
-    pkg_id_buf.resize(buflen);
-    THROW_IF_WIN32_ERROR(GetPackageId(p.get(), &buflen, &pkg_id_buf[0]));
-  } else
-    THROW_IF_WIN32_ERROR(r);
-  auto pkg_id = (PACKAGE_ID *)&pkg_id_buf[0];
-  WCHAR path[MAX_LOADSTR];
-  WCHAR manifest_path[MAX_LOADSTR];
-  buflen = MAX_LOADSTR;
-  THROW_IF_WIN32_ERROR(GetPackagePath(pkg_id, 0, &buflen, path));
-  THROW_IF_FAILED(StringCchCopyW(manifest_path, MAX_LOADSTR, path));
-  THROW_IF_FAILED(
-      StringCchCatW(manifest_path, MAX_LOADSTR, L"\\AppxManifest.xml"));
-  wil::com_ptr<IStream> is;
-  THROW_IF_FAILED(
-      SHCreateStreamOnFileEx(manifest_path, STGM_READ, 0, 0, 0, &is));
-  static IAppxFactory *factory;
-  if (!factory) {
-    THROW_IF_FAILED(
-        CoCreateInstance(CLSID_AppxFactory, nullptr, CLSCTX_INPROC_SERVER,
-                         __uuidof(IAppxFactory), (void **)&factory));
+  THROW_IF_FAILED(StringCchPrintfW(key, MAX_LOADSTR + 32, L"wnd:%p", wnd));
+  return {key, {wnd}};
+}
+
+using logo_candidates =
+    std::vector<std::pair<std::filesystem::path,
+                          std::unordered_map<std::wstring, std::wstring>>>;
+
+logo_candidates find_pri_logos(const WCHAR *path, const std::wstring &logo) {
+  logo_candidates candidates;
+  auto pri{map_file((std::wstring(path) + L"\\resources.pri").c_str())};
+  if (!pri) {
+    return candidates;
   }
-  wil::com_ptr<IAppxManifestReader> reader;
-  THROW_IF_FAILED(factory->CreateManifestReader(is.get(), &reader));
-  wil::com_ptr<IAppxManifestApplicationsEnumerator> iter;
-  THROW_IF_FAILED(reader->GetApplications(&iter));
-  wil::com_ptr<IAppxManifestApplication> app;
-  THROW_IF_FAILED(iter->GetCurrent(&app));
-  WCHAR *logo;
-  THROW_IF_FAILED(app->GetStringValue(L"Square44x44Logo", &logo));
+  std::wstring resource{L"Files\\" + logo};
+  auto found{find_pri_candidates(
+      pri->view.get(), pri->size,
+      {reinterpret_cast<const char16_t *>(resource.data()), resource.size()})};
+  if (!found) {
+    return candidates;
+  }
+  for (const auto &candidate : *found) {
+    std::filesystem::path file{
+        std::wstring(path) + L"\\" +
+        std::wstring(candidate.path.begin(), candidate.path.end())};
+    std::error_code ec;
+    if (!std::filesystem::is_regular_file(file, ec)) {
+      continue;
+    }
+    std::unordered_map<std::wstring, std::wstring> modifiers;
+    for (const auto &[name, value] : candidate.qualifiers) {
+      modifiers[std::wstring(name.begin(), name.end())] =
+          std::wstring(value.begin(), value.end());
+    }
+    candidates.push_back({std::move(file), std::move(modifiers)});
+  }
+  return candidates;
+}
+
+logo_candidates find_logo_files(const WCHAR *path, const std::wstring &logo) {
   std::filesystem::path img_path{std::wstring(path) + L"\\" + logo};
   auto logo_stw{img_path.stem().native() + L"."};
   auto folder_path{img_path.parent_path()};
-  std::vector<std::pair<std::filesystem::path,
-                        std::unordered_map<std::wstring, std::wstring>>>
-      candidates;
+  logo_candidates candidates;
   for (const auto &file :
        std::filesystem::recursive_directory_iterator{folder_path}) {
     if (file.is_regular_file() &&
@@ -511,6 +1158,101 @@ std::optional<std::wstring> get_uwp_icon_path(HWND wnd) {
       }
     }
   }
+  return candidates;
+}
+
+std::optional<std::wstring> utf8_to_wide(std::string_view s) {
+  if (s.empty()) {
+    return std::wstring{};
+  }
+  int len = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, s.data(),
+                                int(s.size()), nullptr, 0);
+  if (len == 0) {
+    return std::nullopt;
+  }
+  std::wstring ws(len, L'\0');
+  THROW_LAST_ERROR_IF(MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS,
+                                          s.data(), int(s.size()), &ws[0],
+                                          len) == 0);
+  return ws;
+}
+
+std::optional<std::wstring> scan_manifest_logo(const WCHAR *manifest_path) {
+  auto manifest{map_file(manifest_path)};
+  if (!manifest) {
+    return std::nullopt;
+  }
+  auto apps{scan_appx_manifest(
+      reinterpret_cast<const char *>(manifest->view.get()), manifest->size)};
+  if (!apps || apps->front().square44x44_logo.empty()) {
+    return std::nullopt;
+  }
+  auto logo{unescape_xml(apps->front().square44x44_logo)};
+  if (!logo) {
+    return std::nullopt;
+  }
+  return utf8_to_wide(*logo);
+}
+
+std::wstring read_manifest_logo(const WCHAR *manifest_path) {
+  wil::com_ptr<IStream> is;
+  THROW_IF_FAILED(
+      SHCreateStreamOnFileEx(manifest_path, STGM_READ, 0, 0, 0, &is));
+  auto factory{get_com_factory(appx_factory, CLSID_AppxFactory)};
+  wil::com_ptr<IAppxManifestReader> reader;
+  THROW_IF_FAILED(factory->CreateManifestReader(is.get(), &reader));
+  wil::com_ptr<IAppxManifestApplicationsEnumerator> iter;
+  THROW_IF_FAILED(reader->GetApplications(&iter));
+  wil::com_ptr<IAppxManifestApplication> app;
+  THROW_IF_FAILED(iter->GetCurrent(&app));
+  wil::unique_cotaskmem_string logo;
+  THROW_IF_FAILED(app->GetStringValue(L"Square44x44Logo", &logo));
+  return logo.get();
+}
+
+std::optional<std::wstring> get_uwp_icon_path(HWND wnd) {
+  DWORD pid;
+  GetWindowThreadProcessId(wnd, &pid);
+  wil::unique_handle p{
+      OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid)};
+  THROW_LAST_ERROR_IF_NULL(p);
+  WCHAR exename[MAX_LOADSTR];
+  DWORD exelen = MAX_LOADSTR;
+  THROW_IF_WIN32_BOOL_FALSE(
+      QueryFullProcessImageNameW(p.get(), 0, exename, &exelen));
+  if (!is_frame_host(exename)) {
+    return std::nullopt;
+  }
+  DWORD real_pid = get_frame_host_real_pid(wnd, pid);
+  if (real_pid == pid) {
+    return L"";
+  }
+  p.reset(OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, real_pid));
+  THROW_LAST_ERROR_IF_NULL(p);
+  UINT32 buflen = 0;
+  LONG r = GetPackageId(p.get(), &buflen, nullptr);
+  std::vector<BYTE> pkg_id_buf;
+  if (r == ERROR_INSUFFICIENT_BUFFER) {
+    pkg_id_buf.resize(buflen);
+    THROW_IF_WIN32_ERROR(GetPackageId(p.get(), &buflen, &pkg_id_buf[0]));
+  } else
+    THROW_IF_WIN32_ERROR(r);
+  auto pkg_id = (PACKAGE_ID *)&pkg_id_buf[0];
+  WCHAR path[MAX_LOADSTR];
+  WCHAR manifest_path[MAX_LOADSTR];
+  buflen = MAX_LOADSTR;
+  THROW_IF_WIN32_ERROR(GetPackagePath(pkg_id, 0, &buflen, path));
+  THROW_IF_FAILED(StringCchCopyW(manifest_path, MAX_LOADSTR, path));
+  THROW_IF_FAILED(
+      StringCchCatW(manifest_path, MAX_LOADSTR, L"\\AppxManifest.xml"));
+  auto logo{scan_manifest_logo(manifest_path)};
+  if (!logo) {
+    logo = read_manifest_logo(manifest_path);
+  }
+  auto candidates{find_pri_logos(path, *logo)};
+  if (candidates.empty()) {
+    candidates = find_logo_files(path, *logo);
+  }
   if (candidates.empty()) {
     return std::nullopt;
   }
@@ -656,12 +1398,7 @@ std::optional<std::wstring> get_uwp_icon_path(HWND wnd) {
 }
 
 void write_icon(HICON icon, IStream *stream) {
-  static IWICImagingFactory *factory;
-  if (!factory) {
-    THROW_IF_FAILED(
-        CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER,
-                         __uuidof(IWICImagingFactory), (void **)&factory));
-  }
+  auto factory{get_com_factory(wic_factory, CLSID_WICImagingFactory)};
   wil::com_ptr<IWICBitmap> source;
   THROW_IF_FAILED(factory->CreateBitmapFromHICON(icon, &source));
   wil::com_ptr<IWICBitmapEncoder> encoder;
@@ -676,6 +1413,116 @@ void write_icon(HICON icon, IStream *stream) {
   THROW_IF_FAILED(encoder->Commit());
 }
 
+wil::unique_hicon load_icon_file(const WCHAR *path, int cx) {
+  auto factory{get_com_factory(wic_factory, CLSID_WICImagingFactory)};
+  wil::com_ptr<IWICBitmapDecoder> decoder;
+  wil::com_ptr<IWICBitmapFrameDecode> frame;
+  wil::com_ptr<IWICBitmapScaler> scaler;
+  wil::com_ptr<IWICFormatConverter> converter;
+  THROW_IF_FAILED(factory->CreateBitmapScaler(&scaler));
+  THROW_IF_FAILED(factory->CreateFormatConverter(&converter));
+  if (FAILED(factory->CreateDecoderFromFilename(
+          path, nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand,
+          &decoder)) ||
+      FAILED(decoder->GetFrame(0, &frame)) ||
+      FAILED(scaler->Initialize(frame.get(), cx, cx,
+                                WICBitmapInterpolationModeFant)) ||
+      FAILED(converter->Initialize(scaler.get(), GUID_WICPixelFormat32bppBGRA,
+                                   WICBitmapDitherTypeNone, nullptr, 0,
+                                   WICBitmapPaletteTypeCustom))) {
+    return {};
+  }
+  BITMAPINFO bi{};
+  bi.bmiHeader.biSize = sizeof(bi.bmiHeader);
+  bi.bmiHeader.biWidth = cx;
+  bi.bmiHeader.biHeight = -cx;
+  bi.bmiHeader.biPlanes = 1;
+  bi.bmiHeader.biBitCount = 32;
+  bi.bmiHeader.biCompression = BI_RGB;
+  void *bits;
+  wil::unique_hbitmap color{
+      CreateDIBSection(nullptr, &bi, DIB_RGB_COLORS, &bits, nullptr, 0)};
+  THROW_LAST_ERROR_IF(!color);
+  if (FAILED(converter->CopyPixels(nullptr, UINT(cx) * 4, UINT(cx * cx) * 4,
+                                   static_cast<BYTE *>(bits)))) {
+    return {};
+  }
+  std::vector<BYTE> mask_bits((cx + 15) / 16 * 2 * cx);
+  wil::unique_hbitmap mask{CreateBitmap(cx, cx, 1, 1, mask_bits.data())};
+  THROW_LAST_ERROR_IF(!mask);
+  ICONINFO ii{TRUE, 0, 0, mask.get(), color.get()};
+  wil::unique_hicon icon{CreateIconIndirect(&ii)};
+  THROW_LAST_ERROR_IF(!icon);
+  return icon;
+}
+
+bool release_idle_resources() {
+  if (!stop_icon_thread(std::chrono::milliseconds(200))) {
+    return false;
+  }
+  auto before{get_memory_counters()};
+  exe_icon_cache.clear();
+  menu.reset();
+  release_island();
+  release_com_factories();
+  CoFreeUnusedLibrariesEx(0, 0);
+  SetProcessWorkingSetSize(GetCurrentProcess(), SIZE_T(-1), SIZE_T(-1));
+  auto after{get_memory_counters()};
+  WCHAR stats[MAX_LOADSTR];
+  THROW_IF_FAILED(StringCchPrintfW(
+      stats, MAX_LOADSTR,
+      L"%ws: released idle resources, private bytes %zu KB -> %zu KB\n",
+      app_title, before.PrivateUsage / 1024, after.PrivateUsage / 1024));
+  OutputDebugStringW(stats);
+  return true;
+}
+
+void wake_idle_resources() {
+  auto start{std::chrono::steady_clock::now()};
+  if (!idle_resources.use(start, [] {
+        if (!native_menu) {
+          init_island();
+        }
+        init_icon_thread();
+      })) {
+    return;
+  }
+  std::chrono::duration<double, std::milli> elapsed{
+      std::chrono::steady_clock::now() - start};
+  WCHAR stats[MAX_LOADSTR];
+  THROW_IF_FAILED(StringCchPrintfW(
+      stats, MAX_LOADSTR, L"%ws: restored idle resources in %.1f ms\n",
+      app_title, elapsed.count()));
+  OutputDebugStringW(stats);
+  schedule_idle();
+}
+
+void schedule_idle() {
+  auto due{idle_resources.due()};
+  if (!due) {
+    KillTimer(hWnd, TIMER_IDLE);
+    return;
+  }
+  auto delay{std::chrono::ceil<std::chrono::milliseconds>(
+      *due - std::chrono::steady_clock::now())};
+  THROW_LAST_ERROR_IF(
+      SetTimer(hWnd, TIMER_IDLE,
+               UINT(std::clamp<long long>(delay.count(), USER_TIMER_MINIMUM,
+                                          USER_TIMER_MAXIMUM)),
+               nullptr) == 0);
+}
+
+void init_idle() {
+  DWORD value = 0;
+  DWORD buf_len = sizeof(DWORD);
+  if (RegGetValueW(HKEY_CURRENT_USER, reg_settings_path, L"IdleTimeout",
+                   RRF_RT_REG_DWORD, nullptr, &value,
+                   &buf_len) == ERROR_SUCCESS) {
+    idle_resources.set_timeout(std::chrono::seconds(value));
+  }
+  wake_idle_resources();
+}
+
 LRESULT CALLBACK WndProc(HWND thisHWnd, UINT message, WPARAM wParam,
                          LPARAM lParam) {
   try {
@@ -683,6 +1530,9 @@ LRESULT CALLBACK WndProc(HWND thisHWnd, UINT message, WPARAM wParam,
       switch (message) {
       case UM_TRAY: {
         static bool menu_showing = false;
+        if (lParam == WM_MOUSEMOVE) {
+          wake_idle_resources();
+        }
         if ((lParam == WM_LBUTTONUP || lParam == WM_RBUTTONUP) &&
             !menu_showing) {
           menu_showing = true;
@@ -700,11 +1550,14 @@ LRESULT CALLBACK WndProc(HWND thisHWnd, UINT message, WPARAM wParam,
           if (is_app_window(foreground)) {
             toggle_top(foreground);
           }
+          if (!idle_resources.alive()) {
+            release_com_factories();
+          }
         }
         break;
       }
       case UM_THEMECHANGED:
-        if (LOWORD(wParam)) {
+        if (LOWORD(wParam) && anchor) {
           create_menu_flyout();
         }
         if (HIWORD(wParam)) {
@@ -712,37 +1565,81 @@ LRESULT CALLBACK WndProc(HWND thisHWnd, UINT message, WPARAM wParam,
         }
         break;
       case UM_SETMENUITEMICON: {
-        std::scoped_lock lck{itmutex};
-        while (!itbq.empty()) {
-          auto uri{std::move(itbq.front().first)};
-          auto item{std::move(itbq.front().second)};
-          itbq.pop();
-          if (!uri.empty()) {
-            auto icon{
-                item.Icon().as<Windows::UI::Xaml::Controls::BitmapIcon>()};
-            icon.UriSource(Windows::Foundation::Uri(uri));
-          } else {
-            Windows::UI::Xaml::Controls::FontIcon icon;
-            icon.FontFamily(
-                Windows::UI::Xaml::Media::FontFamily(L"Segoe MDL2 Assets"));
-            icon.Glyph(L"\uE8BE");
-            Windows::UI::Color green;
-            green.R = green.B = 0;
-            green.G = 128;
-            green.A = 255;
-            icon.Foreground(Windows::UI::Xaml::Media::SolidColorBrush(green));
-            item.Icon(icon);
+        std::vector<std::pair<std::wstring, menu_slot>> icons;
+        {
+          std::scoped_lock lck{itmutex};
+          while (!itbq.empty()) {
+            icons.push_back(std::move(itbq.front()));
+            itbq.pop();
           }
         }
+        for (auto &[uri, slot] : icons) {
+          if (!menu.set_icon(slot, uri)) {
+            continue;
+          }
+          if (native_menu) {
+            set_native_menu_icon(slot.index, uri);
+          } else if (slot.index < flyout_items.size() &&
+                     flyout_items[slot.index]) {
+            set_xaml_menu_icon(flyout_items[slot.index], uri);
+          }
+        }
+        break;
+      }
+      case WM_INITMENUPOPUP:
+        if (HMENU(wParam) == native_popup) {
+          log_menu_opened(L"native");
+        }
         break;
+      case WM_MEASUREITEM: {
+        auto mis{reinterpret_cast<MEASUREITEMSTRUCT *>(lParam)};
+        if (mis->CtlType != ODT_MENU) {
+          return DefWindowProcW(hWnd, message, wParam, lParam);
+        }
+        mis->itemWidth = mis->itemHeight = get_iconsm_metric();
+        return TRUE;
+      }
+      case WM_DRAWITEM: {
+        auto dis{reinterpret_cast<DRAWITEMSTRUCT *>(lParam)};
+        if (dis->CtlType != ODT_MENU) {
+          return DefWindowProcW(hWnd, message, wParam, lParam);
+        }
+        if (dis->itemID > 0 && dis->itemID <= native_icons.size() &&
+            native_icons[dis->itemID - 1]) {
+          const int cx = get_iconsm_metric();
+          DrawIconEx(dis->hDC, dis->rcItem.left,
+                     (dis->rcItem.top + dis->rcItem.bottom - cx) / 2,
+                     native_icons[dis->itemID - 1].get(), cx, cx, 0, nullptr,
+                     DI_NORMAL);
+        }
+        return TRUE;
       }
+      case WM_TIMER:
+        if (wParam == TIMER_ENFORCE_TOPMOST) {
+          enforce_topmost_now();
+        } else if (wParam == TIMER_IDLE) {
+          idle_resources.poll(std::chrono::steady_clock::now(),
+                              release_idle_resources);
+          schedule_idle();
+        }
+        break;
       case UM_MENU_CLOSED:
-        menu_flyout.Items().Clear();
+        if (menu_flyout) {
+          menu_flyout.Items().Clear();
+        }
+        flyout_items.clear();
+        idle_resources.unhold(std::chrono::steady_clock::now());
+        schedule_idle();
         break;
       case WM_DPICHANGED:
         init_tray(true);
         break;
       case WM_DESTROY:
+        if (stop_icon_thread(std::chrono::milliseconds(200))) {
+          release_com_factories();
+        } else {
+          icon_thread.detach();
+        }
         PostQuitMessage(0);
         destroy_tray();
         break;
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class menu_entry_kind { window, separator, enforce_topmost, exit };
+
+struct menu_slot {
+  std::size_t generation;
+  std::size_t index;
+};
+
+template <class Handle> class menu_model {
+public:
+  struct entry {
+    menu_entry_kind kind;
+    Handle wnd;
+    std::wstring text;
+    bool checked;
+    std::optional<std::wstring> icon;
+  };
+
+  std::size_t reset() {
+    items.clear();
+    return ++gen;
+  }
+
+  // Lays out the tray menu: one entry per window, a separator when there
+  // are any, then the enforce-topmost toggle and exit. describe(wnd) returns
+  // the window's text and checked state. Returns the slot of each window.
+  template <class Describe>
+  std::vector<std::pair<Handle, menu_slot>>
+  build(const std::vector<Handle> &wnds, Describe &&describe,
+        std::wstring enforce_text, bool enforce, std::wstring exit_text) {
+    reset();
+    std::vector<std::pair<Handle, menu_slot>> slots;
+    for (auto wnd : wnds) {
+      auto [text, checked] = describe(wnd);
+      slots.push_back({wnd, add_window(wnd, std::move(text), checked)});
+    }
+    if (!wnds.empty()) {
+      add_separator();
+    }
+    add_command(menu_entry_kind::enforce_topmost, std::move(enforce_text),
+                enforce);
+    add_command(menu_entry_kind::exit, std::move(exit_text));
+    return slots;
+  }
+
+  menu_slot add_window(Handle wnd, std::wstring text, bool checked) {
+    return add({menu_entry_kind::window, wnd, std::move(text), checked, {}});
+  }
+
+  void add_separator() { add({menu_entry_kind::separator, {}, {}, false, {}}); }
+
+  void add_command(menu_entry_kind kind, std::wstring text,
+                   bool checked = false) {
+    add({kind, {}, std::move(text), checked, {}});
+  }
+
+  bool set_icon(const menu_slot &slot, std::wstring uri) {
+    if (!current(slot) || items[slot.index].kind != menu_entry_kind::window) {
+      return false;
+    }
+    items[slot.index].icon = std::move(uri);
+    return true;
+  }
+
+  const entry *find(const menu_slot &slot) const {
+    return current(slot) ? &items[slot.index] : nullptr;
+  }
+
+  bool current(const menu_slot &slot) const {
+    return slot.generation == gen && slot.index < items.size();
+  }
+
+  menu_slot slot(std::size_t index) const { return {gen, index}; }
+  const std::vector<entry> &entries() const { return items; }
+  std::size_t generation() const { return gen; }
+
+private:
+  menu_slot add(entry e) {
+    items.push_back(std::move(e));
+    return {gen, items.size() - 1};
+  }
+
+  std::vector<entry> items;
+  std::size_t gen = 0;
+};
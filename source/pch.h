@@ -5,6 +5,7 @@
 #include <appmodel.h>
 #include <appxpackaging.h>
 #include <comdef.h>
+#include <psapi.h>
 #include <shellapi.h>
 #include <shlwapi.h>
 #include <shobjidl.h>
@@ -0,0 +1,288 @@
+#include "pe_icon.h"
+#include "byte_reader.h"
+
+#include <cstring>
+#include <utility>
+
+namespace {
+
+constexpr std::uint32_t RT_ICON_ID = 3;
+constexpr std::uint32_t RT_GROUP_ICON_ID = 14;
+constexpr std::uint32_t RT_VERSION_ID = 16;
+constexpr std::uint32_t RES_SUBDIRECTORY = 0x80000000;
+constexpr std::uint32_t RES_NAME_IS_STRING = 0x80000000;
+
+class pe_reader : public byte_reader {
+public:
+  using byte_reader::byte_reader;
+
+  bool load() {
+    auto mz{u16(0)};
+    auto lfanew{u32(0x3c)};
+    if (!mz || *mz != 0x5a4d || !lfanew) {
+      return false;
+    }
+    std::size_t pe = *lfanew;
+    auto signature{u32(pe)};
+    auto num_sections{u16(pe + 6)};
+    auto opt_size{u16(pe + 20)};
+    if (!signature || *signature != 0x4550 || !num_sections || !opt_size) {
+      return false;
+    }
+    std::size_t opt = pe + 24;
+    auto magic{u16(opt)};
+    if (!magic) {
+      return false;
+    }
+    std::size_t dirs_count_off, dirs_off;
+    if (*magic == 0x10b) {
+      dirs_count_off = opt + 92;
+      dirs_off = opt + 96;
+    } else if (*magic == 0x20b) {
+      dirs_count_off = opt + 108;
+      dirs_off = opt + 112;
+    } else {
+      return false;
+    }
+    auto dirs_count{u32(dirs_count_off)};
+    if (!dirs_count || *dirs_count < 3 ||
+        dirs_off + 3 * 8 > opt + *opt_size) {
+      return false;
+    }
+    auto res_rva{u32(dirs_off + 2 * 8)};
+    if (!res_rva || *res_rva == 0) {
+      return false;
+    }
+    sections = opt + *opt_size;
+    section_count = *num_sections;
+    if (!in_bounds(sections, std::size_t(section_count) * 40)) {
+      return false;
+    }
+    auto root{rva_to_offset(*res_rva, 16)};
+    if (!root) {
+      return false;
+    }
+    res_root = *root;
+    res_limit = section_end(*res_rva);
+    return true;
+  }
+
+  std::optional<std::size_t> rva_to_offset(std::uint32_t rva,
+                                           std::size_t len) const {
+    for (std::size_t i = 0; i < section_count; ++i) {
+      std::size_t sec = sections + i * 40;
+      std::uint32_t va = *u32(sec + 12);
+      std::uint32_t raw_size = *u32(sec + 16);
+      std::uint32_t raw_ptr = *u32(sec + 20);
+      if (rva >= va && rva - va < raw_size) {
+        std::size_t delta = rva - va;
+        if (len > raw_size - delta) {
+          return std::nullopt;
+        }
+        std::size_t off = std::size_t(raw_ptr) + delta;
+        if (!in_bounds(off, len)) {
+          return std::nullopt;
+        }
+        return off;
+      }
+    }
+    return std::nullopt;
+  }
+
+  std::optional<std::size_t> find_entry(std::size_t dir,
+                                        std::optional<std::uint32_t> id,
+                                        bool subdirectory) const {
+    auto named{u16(dir + 12)};
+    auto ids{u16(dir + 14)};
+    if (!named || !ids) {
+      return std::nullopt;
+    }
+    std::size_t count = std::size_t(*named) + *ids;
+    for (std::size_t i = 0; i < count; ++i) {
+      std::size_t entry = dir + 16 + i * 8;
+      auto name{u32(entry)};
+      auto target{u32(entry + 4)};
+      if (!name || !target) {
+        return std::nullopt;
+      }
+      if (id && ((*name & RES_NAME_IS_STRING) || *name != *id)) {
+        continue;
+      }
+      if (bool(*target & RES_SUBDIRECTORY) != subdirectory) {
+        return std::nullopt;
+      }
+      std::size_t off = res_root + (*target & ~RES_SUBDIRECTORY);
+      if (off >= res_limit || !in_bounds(off, 16)) {
+        return std::nullopt;
+      }
+      return off;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<std::pair<std::size_t, std::size_t>>
+  find_resource(std::uint32_t type, std::optional<std::uint32_t> id) const {
+    auto type_dir{find_entry(res_root, type, true)};
+    if (!type_dir) {
+      return std::nullopt;
+    }
+    auto name_dir{find_entry(*type_dir, id, true)};
+    if (!name_dir) {
+      return std::nullopt;
+    }
+    auto data_entry{find_entry(*name_dir, std::nullopt, false)};
+    if (!data_entry) {
+      return std::nullopt;
+    }
+    auto rva{u32(*data_entry)};
+    auto len{u32(*data_entry + 4)};
+    if (!rva || !len) {
+      return std::nullopt;
+    }
+    auto off{rva_to_offset(*rva, *len)};
+    if (!off) {
+      return std::nullopt;
+    }
+    return std::pair{*off, std::size_t(*len)};
+  }
+
+private:
+  std::size_t section_end(std::uint32_t rva) const {
+    for (std::size_t i = 0; i < section_count; ++i) {
+      std::size_t sec = sections + i * 40;
+      std::uint32_t va = *u32(sec + 12);
+      std::uint32_t raw_size = *u32(sec + 16);
+      std::uint32_t raw_ptr = *u32(sec + 20);
+      if (rva >= va && rva - va < raw_size) {
+        return std::size_t(raw_ptr) + raw_size;
+      }
+    }
+    return 0;
+  }
+
+  std::size_t sections = 0;
+  std::size_t section_count = 0;
+  std::size_t res_root = 0;
+  std::size_t res_limit = 0;
+};
+
+struct group_entry {
+  std::uint8_t width;
+  std::uint8_t height;
+  std::uint8_t color_count;
+  std::uint16_t planes;
+  std::uint16_t bit_count;
+  std::uint32_t bytes;
+  std::uint16_t id;
+
+  int pixels() const { return width ? width : 256; }
+};
+
+bool better_entry(const group_entry &left, const group_entry &right, int cx) {
+  int lx = left.pixels(), rx = right.pixels();
+  if (lx != rx) {
+    if (lx == cx || rx == cx) {
+      return lx == cx;
+    }
+    if (lx > cx && rx > cx) {
+      return lx < rx;
+    }
+    return lx > rx;
+  }
+  return left.bit_count > right.bit_count;
+}
+
+} // namespace
+
+std::optional<pe_icon> find_pe_icon(const std::uint8_t *image, std::size_t size,
+                                    int cx) {
+  pe_reader reader{image, size};
+  if (!reader.load()) {
+    return std::nullopt;
+  }
+  auto group{reader.find_resource(RT_GROUP_ICON_ID, std::nullopt)};
+  if (!group || group->second < 6) {
+    return std::nullopt;
+  }
+  auto [group_off, group_len] = *group;
+  auto type{reader.u16(group_off + 2)};
+  auto count{reader.u16(group_off + 4)};
+  if (!type || *type != 1 || !count ||
+      std::size_t(*count) * 14 > group_len - 6) {
+    return std::nullopt;
+  }
+  std::optional<group_entry> best;
+  for (std::size_t i = 0; i < *count; ++i) {
+    std::size_t off = group_off + 6 + i * 14;
+    group_entry entry{image[off],
+                      image[off + 1],
+                      image[off + 2],
+                      *reader.u16(off + 4),
+                      *reader.u16(off + 6),
+                      *reader.u32(off + 8),
+                      *reader.u16(off + 12)};
+    if (!best || better_entry(entry, *best, cx)) {
+      best = entry;
+    }
+  }
+  if (!best) {
+    return std::nullopt;
+  }
+  auto icon{reader.find_resource(RT_ICON_ID, best->id)};
+  if (!icon || icon->second < 8) {
+    return std::nullopt;
+  }
+  const std::uint8_t *data = image + icon->first;
+  static constexpr std::uint8_t png_signature[] = {0x89, 'P',  'N',  'G',
+                                                   0x0d, 0x0a, 0x1a, 0x0a};
+  bool is_png = std::memcmp(data, png_signature, sizeof(png_signature)) == 0;
+  return pe_icon{best->width, best->height, best->color_count,
+                 best->planes, best->bit_count, is_png,
+                 data, icon->second};
+}
+
+std::optional<std::uint64_t> find_pe_file_version(const std::uint8_t *image,
+                                                  std::size_t size) {
+  pe_reader reader{image, size};
+  if (!reader.load()) {
+    return std::nullopt;
+  }
+  auto version{reader.find_resource(RT_VERSION_ID, std::nullopt)};
+  if (!version || version->second < 40 + 16) {
+    return std::nullopt;
+  }
+  auto signature{reader.u32(version->first + 40)};
+  auto ms{reader.u32(version->first + 48)};
+  auto ls{reader.u32(version->first + 52)};
+  if (!signature || *signature != 0xfeef04bd || !ms || !ls) {
+    return std::nullopt;
+  }
+  return std::uint64_t(*ms) << 32 | *ls;
+}
+
+std::vector<std::uint8_t> make_ico(const pe_icon &icon) {
+  std::vector<std::uint8_t> ico;
+  ico.reserve(22 + icon.size);
+  auto put16 = [&ico](std::uint16_t v) {
+    ico.push_back(std::uint8_t(v));
+    ico.push_back(std::uint8_t(v >> 8));
+  };
+  auto put32 = [&ico](std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+      ico.push_back(std::uint8_t(v >> (i * 8)));
+    }
+  };
+  put16(0);
+  put16(1);
+  put16(1);
+  ico.push_back(icon.width);
+  ico.push_back(icon.height);
+  ico.push_back(icon.color_count);
+  ico.push_back(0);
+  put16(icon.planes);
+  put16(icon.bit_count);
+  put32(std::uint32_t(icon.size));
+  put32(22);
+  ico.insert(ico.end(), icon.data, icon.data + icon.size);
+  return ico;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+struct pe_icon {
+  std::uint8_t width;
+  std::uint8_t height;
+  std::uint8_t color_count;
+  std::uint16_t planes;
+  std::uint16_t bit_count;
+  bool is_png;
+  const std::uint8_t *data;
+  std::size_t size;
+};
+
+std::optional<pe_icon> find_pe_icon(const std::uint8_t *image, std::size_t size,
+                                    int cx);
+std::optional<std::uint64_t> find_pe_file_version(const std::uint8_t *image,
+                                                  std::size_t size);
+std::vector<std::uint8_t> make_ico(const pe_icon &icon);
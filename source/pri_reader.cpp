@@ -0,0 +1,630 @@
+#include "pri_reader.h"
+#include "byte_reader.h"
+
+#include <cstring>
+#include <iterator>
+#include <tuple>
+
+namespace {
+
+constexpr std::uint32_t PRI_FILE_TRAILER = 0xdefffade;
+constexpr std::uint32_t PRI_SECTION_TRAILER = 0xdef5fade;
+
+enum value_type : std::uint32_t {
+  VALUE_STRING = 0,
+  VALUE_PATH = 1,
+  VALUE_EMBEDDED_DATA = 2,
+  VALUE_ASCII_STRING = 3,
+  VALUE_UTF8_STRING = 4,
+  VALUE_ASCII_PATH = 5,
+  VALUE_UTF8_PATH = 6,
+};
+
+const char16_t *const qualifier_names[] = {
+    u"language",  u"contrast",  u"scale",          u"homeregion",
+    u"targetsize", u"layoutdir", u"theme",          u"altform",
+    u"dxfeaturelevel", u"config", u"devicefamily", u"custom",
+};
+
+struct section {
+  std::string_view id;
+  byte_reader content;
+};
+
+char16_t fold(char16_t ch) {
+  if (ch >= u'A' && ch <= u'Z') {
+    return ch - u'A' + u'a';
+  }
+  if (ch == u'/') {
+    return u'\\';
+  }
+  return ch;
+}
+
+bool equals_folded(std::u16string_view left, std::u16string_view right) {
+  if (left.size() != right.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < left.size(); ++i) {
+    if (fold(left[i]) != fold(right[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::u16string lowercase(std::u16string s) {
+  for (auto &ch : s) {
+    if (ch >= u'A' && ch <= u'Z') {
+      ch = ch - u'A' + u'a';
+    }
+  }
+  return s;
+}
+
+std::optional<std::u16string> read_utf16z(const byte_reader &r,
+                                          std::size_t off, std::size_t end) {
+  std::u16string s;
+  for (;; off += 2) {
+    if (off + 2 > end) {
+      return std::nullopt;
+    }
+    auto ch{r.u16(off)};
+    if (!ch) {
+      return std::nullopt;
+    }
+    if (*ch == 0) {
+      return s;
+    }
+    s.push_back(char16_t(*ch));
+  }
+}
+
+std::optional<std::u16string> read_asciiz(const byte_reader &r,
+                                          std::size_t off) {
+  std::u16string s;
+  for (;; ++off) {
+    auto ch{r.u8(off)};
+    if (!ch) {
+      return std::nullopt;
+    }
+    if (*ch == 0) {
+      return s;
+    }
+    s.push_back(char16_t(*ch));
+  }
+}
+
+std::optional<std::u16string> decode_utf8(const std::uint8_t *p,
+                                          std::size_t len) {
+  std::u16string s;
+  for (std::size_t i = 0; i < len;) {
+    std::uint32_t cp = p[i];
+    std::size_t extra;
+    if (cp < 0x80) {
+      extra = 0;
+    } else if ((cp & 0xe0) == 0xc0) {
+      cp &= 0x1f;
+      extra = 1;
+    } else if ((cp & 0xf0) == 0xe0) {
+      cp &= 0x0f;
+      extra = 2;
+    } else if ((cp & 0xf8) == 0xf0) {
+      cp &= 0x07;
+      extra = 3;
+    } else {
+      return std::nullopt;
+    }
+    if (extra > len - i - 1) {
+      return std::nullopt;
+    }
+    for (std::size_t k = 1; k <= extra; ++k) {
+      if ((p[i + k] & 0xc0) != 0x80) {
+        return std::nullopt;
+      }
+      cp = cp << 6 | (p[i + k] & 0x3f);
+    }
+    i += extra + 1;
+    if (cp >= 0x10000) {
+      if (cp > 0x10ffff) {
+        return std::nullopt;
+      }
+      cp -= 0x10000;
+      s.push_back(char16_t(0xd800 | cp >> 10));
+      s.push_back(char16_t(0xdc00 | (cp & 0x3ff)));
+    } else {
+      s.push_back(char16_t(cp));
+    }
+  }
+  return s;
+}
+
+std::optional<std::u16string> decode_value(std::uint32_t type,
+                                           const byte_reader &r,
+                                           std::size_t off, std::size_t len) {
+  if (!r.in_bounds(off, len)) {
+    return std::nullopt;
+  }
+  std::u16string s;
+  switch (type) {
+  case VALUE_STRING:
+  case VALUE_PATH:
+    for (std::size_t i = 0; i + 1 < len; i += 2) {
+      s.push_back(char16_t(*r.u16(off + i)));
+    }
+    break;
+  case VALUE_ASCII_STRING:
+  case VALUE_ASCII_PATH:
+    s.assign(r.data + off, r.data + off + len);
+    break;
+  case VALUE_UTF8_STRING:
+  case VALUE_UTF8_PATH: {
+    auto decoded{decode_utf8(r.data + off, len)};
+    if (!decoded) {
+      return std::nullopt;
+    }
+    s = std::move(*decoded);
+    break;
+  }
+  default:
+    return std::nullopt;
+  }
+  while (!s.empty() && s.back() == 0) {
+    s.pop_back();
+  }
+  return s;
+}
+
+class pri_file {
+public:
+  pri_file(const std::uint8_t *data, std::size_t size) : r{data, size} {}
+
+  bool load() {
+    if (!r.in_bounds(0, 32)) {
+      return false;
+    }
+    std::string_view magic{reinterpret_cast<const char *>(r.data), 8};
+    if (magic != "mrm_pri0" && magic != "mrm_pri1" && magic != "mrm_pri2" &&
+        magic != "mrm_prif") {
+      return false;
+    }
+    auto total{r.u32(12)};
+    auto toc{r.u32(16)};
+    auto start{r.u32(20)};
+    auto count{r.u16(24)};
+    if (*total > r.size || *total < 48) {
+      return false;
+    }
+    auto trailer{r.u32(*total - 16)};
+    auto trailer_total{r.u32(*total - 12)};
+    if (*trailer != PRI_FILE_TRAILER || *trailer_total != *total) {
+      return false;
+    }
+    for (std::size_t i = 0; i < *count; ++i) {
+      std::size_t entry = std::size_t(*toc) + i * 32;
+      auto off{r.u32(entry + 24)};
+      auto len{r.u32(entry + 28)};
+      if (!off || !len) {
+        return false;
+      }
+      std::size_t sec = std::size_t(*start) + *off;
+      if (*len < 40 || !r.in_bounds(sec, *len) ||
+          std::memcmp(r.data + entry, r.data + sec, 16) != 0 ||
+          *r.u32(sec + 24) != *len ||
+          *r.u32(sec + *len - 8) != PRI_SECTION_TRAILER ||
+          *r.u32(sec + *len - 4) != *len) {
+        return false;
+      }
+      sections.push_back(
+          {std::string_view{reinterpret_cast<const char *>(r.data + sec), 16},
+           r.sub(sec + 32, *len - 40)});
+    }
+    return true;
+  }
+
+  const section *get(std::size_t index, std::string_view tag) const {
+    if (index >= sections.size() || !is(sections[index], tag)) {
+      return nullptr;
+    }
+    return &sections[index];
+  }
+
+  static bool is(const section &sec, std::string_view tag) {
+    return sec.id.substr(0, tag.size()) == tag;
+  }
+
+  byte_reader r;
+  std::vector<section> sections;
+};
+
+std::optional<std::uint32_t> find_schema_item(const section &schema,
+                                              std::u16string_view resource) {
+  const auto &r{schema.content};
+  if (!r.in_bounds(0, 8) || r.u16(0) != 1) {
+    return std::nullopt;
+  }
+  std::size_t p = 8;
+  bool extended_names = false;
+  if (pri_file::is(schema, "[mrm_hschemaex]")) {
+    if (!r.in_bounds(p, 16) ||
+        std::memcmp(r.data + p, "[def_hnames", 11) != 0) {
+      return std::nullopt;
+    }
+    extended_names = r.data[p + 11] == 'x';
+    p += 16;
+  }
+  auto num_scopes{r.u32(p + 12)};
+  auto num_items{r.u32(p + 16)};
+  if (!num_scopes || !num_items) {
+    return std::nullopt;
+  }
+  // The unique and display names are followed by three 16-bit fields
+  // (reserved, max path length, reserved) and the node counts.
+  std::size_t counts = p + 20 + (std::size_t(*r.u16(2)) + *r.u16(4)) * 2 + 6;
+  std::uint64_t total = std::uint64_t(*num_scopes) + *num_items;
+  auto counts_total{r.u32(counts)};
+  auto counts_scopes{r.u32(counts + 4)};
+  auto counts_items{r.u32(counts + 8)};
+  auto unicode_len{r.u32(counts + 12)};
+  if (!unicode_len || counts_total != total || counts_scopes != num_scopes ||
+      counts_items != num_items) {
+    return std::nullopt;
+  }
+  std::uint64_t nodes = counts + 20 + (extended_names ? 4 : 0);
+  std::uint64_t unicode =
+      nodes + total * 12 + std::uint64_t(*num_scopes) * 8 + *num_items * 2ull;
+  std::uint64_t ascii = unicode + std::uint64_t(*unicode_len) * 2;
+  if (ascii > r.size) {
+    return std::nullopt;
+  }
+
+  auto node_name = [&](std::size_t i) -> std::optional<std::u16string> {
+    std::size_t node = std::size_t(nodes) + i * 12;
+    if (*r.u16(node + 2) == 0) {
+      return std::u16string{};
+    }
+    auto flags{*r.u8(node + 7)};
+    std::size_t name_off = *r.u16(node + 8) | std::size_t(flags & 0xf) << 16;
+    if (flags & 0x20) {
+      return read_asciiz(r, std::size_t(ascii) + name_off);
+    }
+    return read_utf16z(r, std::size_t(unicode) + name_off * 2,
+                       std::size_t(ascii));
+  };
+
+  std::vector<std::u16string_view> parts;
+  for (std::size_t start = 0; start <= resource.size();) {
+    auto end{resource.find_first_of(u"\\/", start)};
+    if (end == std::u16string_view::npos) {
+      end = resource.size();
+    }
+    if (end > start) {
+      parts.push_back(resource.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  if (parts.empty()) {
+    return std::nullopt;
+  }
+
+  for (std::size_t i = 0; i < total; ++i) {
+    std::size_t node = std::size_t(nodes) + i * 12;
+    if (*r.u8(node + 7) & 0x10) {
+      continue;
+    }
+    auto name{node_name(i)};
+    if (!name || !equals_folded(*name, parts.back())) {
+      continue;
+    }
+    std::vector<std::u16string> chain;
+    for (std::size_t n = i, depth = 0;
+         depth < total && depth <= parts.size(); ++depth) {
+      std::size_t parent = *r.u16(std::size_t(nodes) + n * 12);
+      if (parent == n || parent >= total) {
+        break;
+      }
+      auto scope_name{node_name(n)};
+      if (!scope_name) {
+        break;
+      }
+      chain.push_back(std::move(*scope_name));
+      n = parent;
+    }
+    if (chain.size() != parts.size()) {
+      continue;
+    }
+    bool match = true;
+    for (std::size_t k = 0; match && k < parts.size(); ++k) {
+      match = equals_folded(chain[k], parts[parts.size() - 1 - k]);
+    }
+    if (match) {
+      return *r.u16(node + 10);
+    }
+  }
+  return std::nullopt;
+}
+
+struct decision_info {
+  byte_reader r{nullptr, 0};
+  std::size_t decisions, sets, quals, distinct, index, strings;
+  std::size_t decision_count, set_count, qual_count, distinct_count,
+      index_count;
+
+  bool load(const section &sec) {
+    r = sec.content;
+    if (!r.in_bounds(0, 12)) {
+      return false;
+    }
+    distinct_count = *r.u16(0);
+    qual_count = *r.u16(2);
+    set_count = *r.u16(4);
+    decision_count = *r.u16(6);
+    index_count = *r.u16(8);
+    decisions = 12;
+    sets = decisions + decision_count * 4;
+    quals = sets + set_count * 4;
+    distinct = quals + qual_count * 8;
+    index = distinct + distinct_count * 12;
+    strings = index + index_count * 2;
+    return strings <= r.size;
+  }
+
+  std::optional<std::size_t> index_at(std::size_t i) const {
+    if (i >= index_count) {
+      return std::nullopt;
+    }
+    return *r.u16(index + i * 2);
+  }
+
+  std::optional<std::vector<std::vector<std::pair<std::u16string,
+                                                  std::u16string>>>>
+  qualifier_sets(std::size_t decision) const {
+    if (decision >= decision_count) {
+      return std::nullopt;
+    }
+    std::size_t first_set = *r.u16(decisions + decision * 4);
+    std::size_t num_sets = *r.u16(decisions + decision * 4 + 2);
+    std::vector<std::vector<std::pair<std::u16string, std::u16string>>>
+        result;
+    for (std::size_t s = 0; s < num_sets; ++s) {
+      auto set{index_at(first_set + s)};
+      if (!set || *set >= set_count) {
+        return std::nullopt;
+      }
+      std::size_t first_qual = *r.u16(sets + *set * 4);
+      std::size_t num_quals = *r.u16(sets + *set * 4 + 2);
+      auto &qualifiers{result.emplace_back()};
+      for (std::size_t q = 0; q < num_quals; ++q) {
+        auto qual{index_at(first_qual + q)};
+        if (!qual || *qual >= qual_count) {
+          return std::nullopt;
+        }
+        std::size_t d = *r.u16(quals + *qual * 8);
+        if (d >= distinct_count) {
+          return std::nullopt;
+        }
+        std::size_t type = *r.u16(distinct + d * 12 + 2);
+        std::size_t operand = *r.u32(distinct + d * 12 + 8);
+        auto value{read_utf16z(r, strings + operand * 2, r.size)};
+        if (!value || type >= std::size(qualifier_names)) {
+          return std::nullopt;
+        }
+        qualifiers.push_back({qualifier_names[type], lowercase(*value)});
+      }
+    }
+    return result;
+  }
+};
+
+std::optional<std::u16string> read_data_item(const section &sec,
+                                             std::size_t index,
+                                             std::uint32_t type) {
+  const auto &r{sec.content};
+  auto num_strings{r.u16(4)};
+  auto num_blobs{r.u16(6)};
+  if (!num_strings || !num_blobs) {
+    return std::nullopt;
+  }
+  std::size_t blobs = 12 + std::size_t(*num_strings) * 4;
+  std::size_t data = blobs + std::size_t(*num_blobs) * 8;
+  if (data > r.size) {
+    return std::nullopt;
+  }
+  std::size_t off, len;
+  if (index < *num_strings) {
+    off = *r.u16(12 + index * 4);
+    len = *r.u16(12 + index * 4 + 2);
+  } else if (index - *num_strings < *num_blobs) {
+    std::size_t entry = blobs + (index - *num_strings) * 8;
+    off = *r.u32(entry);
+    len = *r.u32(entry + 4);
+  } else {
+    return std::nullopt;
+  }
+  if (off > r.size - data) {
+    return std::nullopt;
+  }
+  return decode_value(type, r, data + off, len);
+}
+
+std::optional<std::vector<pri_candidate>>
+find_map_candidates(const pri_file &pri, const section &map,
+                    std::u16string_view resource) {
+  const auto &r{map.content};
+  if (!r.in_bounds(0, 32)) {
+    return std::nullopt;
+  }
+  std::size_t env_len = *r.u16(0);
+  std::size_t schema_index = *r.u16(4);
+  std::size_t schema_ref_len = *r.u16(6);
+  std::size_t decision_index = *r.u16(8);
+  std::size_t type_count = *r.u16(10);
+  std::size_t small_map_count = *r.u16(12);
+  std::size_t small_group_count = *r.u16(14);
+  std::size_t small_info_count = *r.u32(16);
+  std::size_t candidate_count = *r.u32(20);
+  std::size_t data_len = *r.u32(24);
+  std::size_t large_len = *r.u32(28);
+
+  const section *schema{pri.get(schema_index, "[mrm_hschema")};
+  const section *decision_sec{pri.get(decision_index, "[mrm_decn_info]")};
+  if (!schema || !decision_sec) {
+    return std::nullopt;
+  }
+  auto item{find_schema_item(*schema, resource)};
+  if (!item) {
+    return std::nullopt;
+  }
+  decision_info decisions;
+  if (!decisions.load(*decision_sec)) {
+    return std::nullopt;
+  }
+
+  std::uint64_t types = 32 + env_len + schema_ref_len;
+  std::uint64_t small_maps = types + type_count * 8;
+  std::uint64_t small_groups = small_maps + small_map_count * 4;
+  std::uint64_t small_infos = small_groups + small_group_count * 4;
+  std::uint64_t large = small_infos + std::uint64_t(small_info_count) * 4;
+  std::uint64_t candidates = large + large_len;
+  std::uint64_t strings = candidates + std::uint64_t(candidate_count) * 8;
+  if (strings > r.size || data_len > r.size - strings) {
+    return std::nullopt;
+  }
+  std::size_t large_map_count = 0, large_group_count = 0, large_info_count = 0;
+  std::uint64_t large_maps = large + 12, large_groups = 0, large_infos = 0;
+  if (large_len != 0) {
+    if (large_len < 12) {
+      return std::nullopt;
+    }
+    large_map_count = *r.u32(std::size_t(large));
+    large_group_count = *r.u32(std::size_t(large) + 4);
+    large_info_count = *r.u32(std::size_t(large) + 8);
+    large_groups = large_maps + std::uint64_t(large_map_count) * 8;
+    large_infos = large_groups + std::uint64_t(large_group_count) * 8;
+    if (large_infos + std::uint64_t(large_info_count) * 8 != candidates) {
+      return std::nullopt;
+    }
+  }
+
+  auto map_entry = [&](std::size_t i) {
+    if (i < small_map_count) {
+      return std::pair<std::size_t, std::size_t>{
+          *r.u16(std::size_t(small_maps) + i * 4),
+          *r.u16(std::size_t(small_maps) + i * 4 + 2)};
+    }
+    i -= small_map_count;
+    return std::pair<std::size_t, std::size_t>{
+        *r.u32(std::size_t(large_maps) + i * 8),
+        *r.u32(std::size_t(large_maps) + i * 8 + 4)};
+  };
+  auto group_entry = [&](std::size_t i) {
+    if (i < small_group_count) {
+      return std::pair<std::size_t, std::size_t>{
+          *r.u16(std::size_t(small_groups) + i * 4),
+          *r.u16(std::size_t(small_groups) + i * 4 + 2)};
+    }
+    i -= small_group_count;
+    return std::pair<std::size_t, std::size_t>{
+        *r.u32(std::size_t(large_groups) + i * 8),
+        *r.u32(std::size_t(large_groups) + i * 8 + 4)};
+  };
+  auto info_entry = [&](std::size_t i) {
+    if (i < small_info_count) {
+      return std::pair<std::size_t, std::size_t>{
+          *r.u16(std::size_t(small_infos) + i * 4),
+          *r.u16(std::size_t(small_infos) + i * 4 + 2)};
+    }
+    i -= small_info_count;
+    return std::pair<std::size_t, std::size_t>{
+        *r.u32(std::size_t(large_infos) + i * 8),
+        *r.u32(std::size_t(large_infos) + i * 8 + 4)};
+  };
+  std::size_t group_count = small_group_count + large_group_count;
+  std::size_t info_count = small_info_count + large_info_count;
+
+  std::optional<std::size_t> info;
+  for (std::size_t i = 0; !info && i < small_map_count + large_map_count;
+       ++i) {
+    auto [first_item, group] = map_entry(i);
+    std::size_t group_size = 1, first_info = group - group_count;
+    if (group < group_count) {
+      std::tie(group_size, first_info) = group_entry(group);
+    }
+    if (*item >= first_item && *item - first_item < group_size) {
+      info = first_info + (*item - first_item);
+    }
+  }
+  if (!info || *info >= info_count) {
+    return std::nullopt;
+  }
+  auto [decision, first_candidate] = info_entry(*info);
+  auto qualifier_sets{decisions.qualifier_sets(decision)};
+  if (!qualifier_sets) {
+    return std::nullopt;
+  }
+
+  std::vector<pri_candidate> result;
+  for (std::size_t i = 0; i < qualifier_sets->size(); ++i) {
+    std::size_t candidate = first_candidate + i;
+    if (candidate >= candidate_count) {
+      return std::nullopt;
+    }
+    std::size_t entry = std::size_t(candidates) + candidate * 8;
+    auto kind{*r.u8(entry)};
+    auto type_slot{*r.u8(entry + 1)};
+    if (type_slot >= type_count) {
+      return std::nullopt;
+    }
+    auto type{*r.u32(std::size_t(types) + type_slot * 8 + 4)};
+    std::optional<std::u16string> value;
+    if (kind == 0x00) {
+      std::size_t len = *r.u16(entry + 2);
+      std::size_t off = *r.u32(entry + 4);
+      if (off > data_len || len > data_len - off) {
+        return std::nullopt;
+      }
+      value = decode_value(type, r, std::size_t(strings) + off, len);
+    } else if (kind == 0x01) {
+      std::size_t source_file = *r.u16(entry + 2);
+      std::size_t data_item = *r.u16(entry + 4);
+      std::size_t data_section = *r.u16(entry + 6);
+      const section *items{pri.get(data_section, "[mrm_dataitem]")};
+      if (source_file != 0 || !items) {
+        continue;
+      }
+      value = read_data_item(*items, data_item, type);
+    } else {
+      return std::nullopt;
+    }
+    if (!value) {
+      return std::nullopt;
+    }
+    if (type != VALUE_PATH && type != VALUE_ASCII_PATH &&
+        type != VALUE_UTF8_PATH) {
+      continue;
+    }
+    result.push_back({std::move(*value), std::move((*qualifier_sets)[i])});
+  }
+  return result;
+}
+
+} // namespace
+
+std::optional<std::vector<pri_candidate>>
+find_pri_candidates(const std::uint8_t *data, std::size_t size,
+                    std::u16string_view resource) {
+  pri_file pri{data, size};
+  if (!pri.load()) {
+    return std::nullopt;
+  }
+  for (const auto &sec : pri.sections) {
+    if (!pri_file::is(sec, "[mrm_res_map")) {
+      continue;
+    }
+    auto candidates{find_map_candidates(pri, sec, resource)};
+    if (candidates && !candidates->empty()) {
+      return candidates;
+    }
+  }
+  return std::nullopt;
+}
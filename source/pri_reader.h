@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct pri_candidate {
+  std::u16string path;
+  std::vector<std::pair<std::u16string, std::u16string>> qualifiers;
+};
+
+std::optional<std::vector<pri_candidate>>
+find_pri_candidates(const std::uint8_t *data, std::size_t size,
+                    std::u16string_view resource);
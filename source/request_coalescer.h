@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template <class Key, class Arg, class Waiter, class Hash = std::hash<Key>>
+class request_coalescer {
+public:
+  void enqueue(const Key &key, const Arg &arg, Waiter waiter) {
+    ++request_count;
+    auto it{pending.find(key)};
+    if (it == pending.end()) {
+      ++call_count;
+      it = pending.emplace(key, flight{arg, {}}).first;
+      order.push_back(key);
+    }
+    it->second.waiters.push_back(std::move(waiter));
+  }
+
+  std::optional<std::pair<Key, Arg>> next() const {
+    if (order.empty()) {
+      return std::nullopt;
+    }
+    return std::pair{order.front(), pending.at(order.front()).arg};
+  }
+
+  std::vector<Waiter> complete(const Key &key) {
+    std::vector<Waiter> waiters;
+    auto it{pending.find(key)};
+    if (it != pending.end()) {
+      waiters = std::move(it->second.waiters);
+      pending.erase(it);
+    }
+    for (auto o{order.begin()}; o != order.end(); ++o) {
+      if (*o == key) {
+        order.erase(o);
+        break;
+      }
+    }
+    return waiters;
+  }
+
+  // Drops the waiters matching stale, and every call left without waiters.
+  template <class Stale> void prune(Stale stale) {
+    for (auto it{pending.begin()}; it != pending.end();) {
+      auto &waiters{it->second.waiters};
+      waiters.erase(std::remove_if(waiters.begin(), waiters.end(), stale),
+                    waiters.end());
+      if (waiters.empty()) {
+        order.erase(std::find(order.begin(), order.end(), it->first));
+        it = pending.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  bool empty() const { return order.empty(); }
+  std::size_t requests() const { return request_count; }
+  std::size_t calls() const { return call_count; }
+
+private:
+  struct flight {
+    Arg arg;
+    std::vector<Waiter> waiters;
+  };
+
+  std::unordered_map<Key, flight, Hash> pending;
+  std::deque<Key> order;
+  std::size_t request_count = 0;
+  std::size_t call_count = 0;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+enum class pin_state { topmost, lost, gone };
+
+template <class Handle> class topmost_guard {
+public:
+  using clock = std::chrono::steady_clock;
+
+  topmost_guard(clock::duration debounce, clock::duration max_delay,
+                std::size_t burst, clock::duration burst_window)
+      : debounce{debounce}, max_delay{max_delay}, burst{burst},
+        burst_window{burst_window} {}
+
+  void pin(Handle wnd) { pinned[wnd].clear(); }
+  void unpin(Handle wnd) { pinned.erase(wnd); }
+  bool empty() const { return pinned.empty(); }
+
+  void notify(clock::time_point now) {
+    if (pinned.empty()) {
+      return;
+    }
+    if (!first_event) {
+      first_event = now;
+    }
+    deadline = std::min(now + debounce, *first_event + max_delay);
+  }
+
+  std::optional<clock::time_point> due() const {
+    if (deadline && retry) {
+      return std::min(*deadline, *retry);
+    }
+    return deadline ? deadline : retry;
+  }
+
+  template <class State>
+  std::vector<Handle> poll(clock::time_point now, State &&state) {
+    std::vector<Handle> reassert;
+    auto when{due()};
+    if (!when || now < *when) {
+      return reassert;
+    }
+    if (deadline && *deadline <= now) {
+      deadline.reset();
+      first_event.reset();
+    }
+    retry.reset();
+    for (auto it{pinned.begin()}; it != pinned.end();) {
+      auto s{state(it->first)};
+      if (s == pin_state::gone) {
+        it = pinned.erase(it);
+        continue;
+      }
+      if (s == pin_state::lost) {
+        auto &history{it->second};
+        while (!history.empty() && now - history.front() >= burst_window) {
+          history.pop_front();
+        }
+        if (history.size() < burst) {
+          history.push_back(now);
+          reassert.push_back(it->first);
+        } else {
+          // Check again once the oldest re-pin leaves the window, even if
+          // no further z-order events arrive.
+          auto at{history.front() + burst_window};
+          retry = retry ? std::min(*retry, at) : at;
+        }
+      }
+      ++it;
+    }
+    return reassert;
+  }
+
+private:
+  clock::duration debounce;
+  clock::duration max_delay;
+  std::size_t burst;
+  clock::duration burst_window;
+  std::unordered_map<Handle, std::deque<clock::time_point>> pinned;
+  std::optional<clock::time_point> first_event;
+  std::optional<clock::time_point> deadline;
+  std::optional<clock::time_point> retry;
+};
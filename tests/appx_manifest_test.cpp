@@ -0,0 +1,163 @@
+#include "appx_manifest.h"
+#include "check.h"
+
+namespace {
+
+std::optional<std::vector<appx_application>>
+scan(const std::vector<std::uint8_t> &xml) {
+  return scan_appx_manifest(reinterpret_cast<const char *>(xml.data()),
+                            xml.size());
+}
+
+std::optional<std::vector<appx_application>> scan(std::string_view xml) {
+  return scan_appx_manifest(xml.data(), xml.size());
+}
+
+bool within(std::string_view view, const char *data, std::size_t size) {
+  return view.empty() ||
+         (view.data() >= data && view.data() + view.size() <= data + size);
+}
+
+void test_default_namespace() {
+  auto xml{read_fixture("appx/default_ns.xml")};
+  auto apps{scan(xml)};
+  REQUIRE(apps && apps->size() == 1);
+  const auto &app{apps->front()};
+  CHECK(app.id == "App");
+  CHECK(app.square44x44_logo == "Assets\\Square44x44Logo.png");
+  CHECK(app.square150x150_logo == "Assets\\Square150x150Logo.png");
+  CHECK(app.background_color == "transparent");
+}
+
+void test_prefixed_namespaces() {
+  auto xml{read_fixture("appx/prefixed_ns.xml")};
+  auto apps{scan(xml)};
+  REQUIRE(apps && apps->size() == 2);
+  CHECK((*apps)[0].id == "Writer");
+  CHECK((*apps)[0].square44x44_logo == "Images\\Writer44.png");
+  CHECK((*apps)[0].square150x150_logo == "Images\\Writer150.png");
+  CHECK((*apps)[0].background_color == "#2B579A");
+  CHECK((*apps)[1].id == "Sheets");
+  CHECK((*apps)[1].square44x44_logo == "Images\\Sheets44.png");
+  CHECK((*apps)[1].background_color == "#217346");
+}
+
+void test_comments_cdata_pi() {
+  auto xml{read_fixture("appx/markup.xml")};
+  auto apps{scan(xml)};
+  REQUIRE(apps && apps->size() == 1);
+  CHECK(apps->front().id == "Viewer");
+  CHECK(apps->front().square44x44_logo == "Assets\\Viewer44.png");
+  CHECK(apps->front().square150x150_logo == "Assets\\Viewer150.png");
+  CHECK(apps->front().background_color == "#000000");
+}
+
+void test_entities() {
+  auto xml{read_fixture("appx/entities.xml")};
+  auto apps{scan(xml)};
+  REQUIRE(apps && apps->size() == 1);
+  const auto &app{apps->front()};
+  CHECK(app.id == "Tom&amp;Jerry");
+  CHECK(unescape_xml(app.id) == "Tom&Jerry");
+  CHECK(unescape_xml(app.square44x44_logo) ==
+        "Assets\\Tom&Jerry \xc3\xa9\xf0\x9f\x98\x80.png");
+  CHECK(unescape_xml(app.square150x150_logo) ==
+        "Assets\\\"Quoted\"'s.png");
+  CHECK(unescape_xml(app.background_color) == "#FF8800");
+}
+
+void test_rejected_documents() {
+  for (auto name : {"appx/doctype.xml", "appx/utf16le.xml",
+                    "appx/utf16be.xml", "appx/utf16le_nobom.xml"}) {
+    CHECK(!scan(read_fixture(name)));
+  }
+  CHECK(!scan(std::string_view{}));
+  CHECK(!scan("<Package><Applications/></Package>"));
+  CHECK(!scan("<Application Id=\"a\"><Application Id=\"b\"/></Application>"));
+  CHECK(!scan("<Application Id=\"a\"><VisualElements/>"));
+  CHECK(!scan("<Application Id=\"a<b\"/>"));
+  CHECK(!scan("<Application Id=a/>"));
+  CHECK(!scan("<Application Id=\"a\"/><!-- unterminated"));
+  CHECK(!scan("<Application Id=\"a\"/><![CDATA[ unterminated"));
+  CHECK(!scan("<Application Id=\"a\"/></>"));
+  auto apps{scan("<Application Id=\"a\"/>")};
+  REQUIRE(apps && apps->size() == 1);
+  CHECK(apps->front().id == "a");
+  CHECK(apps->front().square44x44_logo.empty());
+}
+
+void test_visual_elements_scope() {
+  // VisualElements outside an Application are ignored.
+  auto apps{scan("<VisualElements Square44x44Logo=\"x.png\"/>"
+                 "<Application Id=\"a\"></Application>")};
+  REQUIRE(apps && apps->size() == 1);
+  CHECK(apps->front().square44x44_logo.empty());
+}
+
+void test_truncated(const char *name, std::string_view app_tag) {
+  auto xml{read_fixture(name)};
+  std::string_view full{reinterpret_cast<const char *>(xml.data()),
+                        xml.size()};
+  std::vector<std::pair<std::size_t, std::size_t>> spans;
+  std::string end_tag{"</" + std::string{app_tag} + ">"};
+  for (auto start{full.find("<" + std::string{app_tag} + " ")};
+       start != std::string_view::npos;
+       start = full.find("<" + std::string{app_tag} + " ", start + 1)) {
+    spans.push_back({start, full.find(end_tag, start) + end_tag.size()});
+  }
+  REQUIRE(!spans.empty());
+  for (std::size_t len = 0; len < xml.size(); ++len) {
+    std::string prefix{full.substr(0, len)};
+    auto apps{scan(std::string_view{prefix})};
+    std::size_t complete = 0;
+    bool inside = false;
+    for (auto [start, end] : spans) {
+      complete += end <= len;
+      inside = inside || (start < len && len < end);
+    }
+    if (inside || complete == 0) {
+      CHECK(!apps);
+    }
+    if (!apps) {
+      continue;
+    }
+    CHECK(apps->size() == complete);
+    for (const auto &app : *apps) {
+      CHECK(within(app.id, prefix.data(), prefix.size()));
+      CHECK(within(app.square44x44_logo, prefix.data(), prefix.size()));
+      CHECK(within(app.square150x150_logo, prefix.data(), prefix.size()));
+      CHECK(within(app.background_color, prefix.data(), prefix.size()));
+    }
+  }
+}
+
+void test_unescape() {
+  CHECK(unescape_xml("") == "");
+  CHECK(unescape_xml("plain\\path.png") == "plain\\path.png");
+  CHECK(unescape_xml("&lt;&gt;&amp;&quot;&apos;") == "<>&\"'");
+  CHECK(unescape_xml("a\tb\r\nc") == "a b  c");
+  CHECK(unescape_xml("&#65;&#x42;&#X43;") == std::nullopt);
+  CHECK(unescape_xml("&#65;&#x42;&#x43;") == "ABC");
+  CHECK(unescape_xml("&#x7FF;&#xFFFF;&#x10FFFF;") ==
+        "\xdf\xbf\xef\xbf\xbf\xf4\x8f\xbf\xbf");
+  for (auto bad : {"&", "&amp", "&;", "&unknown;", "&#;", "&#x;", "&#0;",
+                   "&#x0;", "&#xD800;", "&#xDFFF;", "&#x110000;", "&#xg;",
+                   "&#12a;", "&#123456789;", "&#x123456789;", "&LT;"}) {
+    CHECK(!unescape_xml(bad));
+  }
+}
+
+} // namespace
+
+int main() {
+  test_default_namespace();
+  test_prefixed_namespaces();
+  test_comments_cdata_pi();
+  test_entities();
+  test_rejected_documents();
+  test_visual_elements_scope();
+  test_truncated("appx/default_ns.xml", "Application");
+  test_truncated("appx/prefixed_ns.xml", "m:Application");
+  test_unescape();
+  return check_result();
+}
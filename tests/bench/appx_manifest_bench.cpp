@@ -0,0 +1,47 @@
+#include "appx_manifest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+// Usage: appx_manifest_bench <iterations> <manifest>...
+// Scans each manifest and unescapes its first logo, reporting throughput.
+// The fixtures ctest passes are short hand-written manifests; measure with
+// the AppxManifest.xml files of installed packages for realistic numbers.
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::fprintf(stderr, "usage: %s <iterations> <manifest>...\n", argv[0]);
+    return 1;
+  }
+  long iterations = std::strtol(argv[1], nullptr, 10);
+  if (iterations <= 0) {
+    return 1;
+  }
+  std::size_t found = 0;
+  for (int i = 2; i < argc; ++i) {
+    std::ifstream in{argv[i], std::ios::binary};
+    if (!in) {
+      std::fprintf(stderr, "cannot open %s\n", argv[i]);
+      return 1;
+    }
+    std::string xml{std::istreambuf_iterator<char>{in}, {}};
+    auto start{std::chrono::steady_clock::now()};
+    for (long n = 0; n < iterations; ++n) {
+      auto apps{scan_appx_manifest(xml.data(), xml.size())};
+      if (apps && unescape_xml(apps->front().square44x44_logo)) {
+        ++found;
+      }
+    }
+    std::chrono::duration<double> elapsed{std::chrono::steady_clock::now() -
+                                          start};
+    double bytes = double(xml.size()) * double(iterations);
+    std::printf("%-40s %10.1f MB/s %10.0f ns/scan\n", argv[i],
+                bytes / elapsed.count() / 1e6,
+                elapsed.count() * 1e9 / double(iterations));
+  }
+  std::printf("%zu scans found a logo\n", found);
+  return 0;
+}
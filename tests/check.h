@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+inline int check_failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,    \
+                   #cond);                                                     \
+      ++check_failures;                                                        \
+    }                                                                          \
+  } while (0)
+
+#define REQUIRE(cond)                                                          \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: REQUIRE(%s) failed\n", __FILE__, __LINE__,  \
+                   #cond);                                                     \
+      std::exit(1);                                                            \
+    }                                                                          \
+  } while (0)
+
+inline std::vector<std::uint8_t> read_file(const std::string &path) {
+  std::ifstream in{path, std::ios::binary};
+  REQUIRE(in);
+  return {std::istreambuf_iterator<char>{in}, {}};
+}
+
+inline std::vector<std::uint8_t> read_fixture(const std::string &name) {
+  return read_file(std::string{FIXTURE_DIR} + "/" + name);
+}
+
+inline int check_result() {
+  if (check_failures) {
+    std::fprintf(stderr, "%d check(s) failed\n", check_failures);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Writes png_icon.exe: a PE32+ image with a .rsrc section holding a 16x16
+BMP icon, a 256x256 PNG icon and a VS_VERSION_INFO of 2.3.4.5."""
+
+import struct
+import sys
+import zlib
+from pathlib import Path
+
+RT_ICON = 3
+RT_GROUP_ICON = 14
+RT_VERSION = 16
+RSRC_RVA = 0x1000
+RSRC_RAW = 0x200
+
+
+def bmp_icon(size):
+    header = struct.pack("<IiiHHIIiiII", 40, size, size * 2, 1, 32, 0, 0, 0,
+                         0, 0, 0)
+    pixels = bytes([0x20, 0x80, 0x20, 0xff]) * (size * size)
+    mask = bytes(((size + 31) // 32) * 4 * size)
+    return header + pixels + mask
+
+
+def png_icon(size):
+    def chunk(kind, data):
+        return (struct.pack(">I", len(data)) + kind + data +
+                struct.pack(">I", zlib.crc32(kind + data)))
+    rows = b"".join(b"\0" + bytes([0x20, 0x80, 0x20, 0xff]) * size
+                    for _ in range(size))
+    return (b"\x89PNG\r\n\x1a\n" +
+            chunk(b"IHDR", struct.pack(">IIBBBBB", size, size, 8, 6, 0, 0, 0))
+            + chunk(b"IDAT", zlib.compress(rows, 9)) + chunk(b"IEND", b""))
+
+
+def group_icon(entries):
+    data = struct.pack("<HHH", 0, 1, len(entries))
+    for width, bits, length, ident in entries:
+        data += struct.pack("<BBBBHHIH", width, width, 0, 0, 1, bits, length,
+                            ident)
+    return data
+
+
+def version_info(ms, ls):
+    key = "VS_VERSION_INFO\0".encode("utf-16-le")
+    fixed = struct.pack("<13I", 0xfeef04bd, 0x10000, ms, ls, ms, ls, 0x3f, 0,
+                        0x40004, 1, 0, 0, 0)
+    body = key + b"\0\0" + fixed
+    return struct.pack("<HHH", 6 + len(body), len(fixed), 0) + body
+
+
+def rsrc(resources):
+    """resources: {type: {id: data}}, laid out as type/name/language
+    directories, then data entries, then the data itself."""
+    dirs = []
+
+    def directory(entries):
+        dirs.append(entries)
+        return len(dirs) - 1
+
+    leaves = []
+    type_entries = []
+    for rtype, items in sorted(resources.items()):
+        name_entries = []
+        for rid, data in sorted(items.items()):
+            leaves.append(data)
+            lang = directory([(0x409, ("leaf", len(leaves) - 1))])
+            name_entries.append((rid, ("dir", lang)))
+        type_entries.append((rtype, ("dir", directory(name_entries))))
+    root = directory(type_entries)
+    order = [root] + [i for i in range(len(dirs)) if i != root]
+    dir_off, off = {}, 0
+    for i in order:
+        dir_off[i] = off
+        off += 16 + 8 * len(dirs[i])
+    leaf_off = [off + 16 * i for i in range(len(leaves))]
+    off += 16 * len(leaves)
+    data_off = []
+    for data in leaves:
+        off = (off + 7) & ~7
+        data_off.append(off)
+        off += len(data)
+    out = bytearray(off)
+    for i in order:
+        struct.pack_into("<IIHHHH", out, dir_off[i], 0, 0, 0, 0, 0,
+                         len(dirs[i]))
+        for n, (ident, (kind, target)) in enumerate(dirs[i]):
+            value = (dir_off[target] | 0x80000000 if kind == "dir"
+                     else leaf_off[target])
+            struct.pack_into("<II", out, dir_off[i] + 16 + 8 * n, ident, value)
+    for i, data in enumerate(leaves):
+        struct.pack_into("<IIII", out, leaf_off[i], RSRC_RVA + data_off[i],
+                         len(data), 0, 0)
+        out[data_off[i]:data_off[i] + len(data)] = data
+    return bytes(out)
+
+
+def pe32plus(section):
+    raw_size = (len(section) + 0x1ff) & ~0x1ff
+    virtual_size = (len(section) + 0xfff) & ~0xfff
+    dos = bytearray(0x40)
+    struct.pack_into("<H", dos, 0, 0x5a4d)
+    struct.pack_into("<I", dos, 0x3c, 0x40)
+    coff = struct.pack("<4sHHIIIHH", b"PE\0\0", 0x8664, 1, 0, 0, 0, 240,
+                       0x22)
+    opt = bytearray(240)
+    struct.pack_into("<HBB", opt, 0, 0x20b, 14, 0)
+    struct.pack_into("<Q", opt, 24, 0x140000000)
+    struct.pack_into("<II", opt, 32, 0x1000, 0x200)
+    struct.pack_into("<HH", opt, 48, 6, 0)
+    struct.pack_into("<II", opt, 56, RSRC_RVA + virtual_size, RSRC_RAW)
+    struct.pack_into("<H", opt, 68, 2)
+    struct.pack_into("<I", opt, 108, 16)
+    struct.pack_into("<II", opt, 112 + 2 * 8, RSRC_RVA, len(section))
+    header = struct.pack("<8sIIII12xI", b".rsrc", len(section), RSRC_RVA,
+                         raw_size, RSRC_RAW, 0x40000040)
+    image = bytes(dos) + coff + bytes(opt) + header
+    image += bytes(RSRC_RAW - len(image))
+    return image + section + bytes(raw_size - len(section))
+
+
+def main():
+    small, large = bmp_icon(16), png_icon(256)
+    section = rsrc({
+        RT_ICON: {1: small, 2: large},
+        RT_GROUP_ICON: {1: group_icon([(16, 32, len(small), 1),
+                                       (0, 32, len(large), 2)])},
+        RT_VERSION: {1: version_info(0x00020003, 0x00040005)},
+    })
+    out = Path(sys.argv[1] if len(sys.argv) > 1 else
+               Path(__file__).with_name("png_icon.exe"))
+    out.write_bytes(pe32plus(section))
+
+
+if __name__ == "__main__":
+    main()
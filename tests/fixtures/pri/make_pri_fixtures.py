@@ -0,0 +1,252 @@
+#!/usr/bin/env python3
+"""Writes the PRI fixtures following the resources.pri layout (file header,
+table of contents, [mrm_hschema(ex)], [mrm_decn_info], [mrm_dataitem] and
+[mrm_res_map2_] sections).
+
+hschema.pri: a plain hierarchical schema with UTF-16 names, small item maps
+and candidates stored inline in the resource map.
+
+hschemaex.pri: an extended schema with [def_hnamesx] names, ASCII node
+names, large item maps and candidates stored in a data item section."""
+
+import struct
+from pathlib import Path
+
+VALUE_STRING, VALUE_PATH, VALUE_ASCII_PATH, VALUE_UTF8_PATH = 0, 1, 5, 6
+QUALIFIERS = {"language": 0, "contrast": 1, "scale": 2, "targetsize": 4,
+              "altform": 7}
+
+
+def u16(*values):
+    return struct.pack("<%dH" % len(values), *values)
+
+
+def u32(*values):
+    return struct.pack("<%dI" % len(values), *values)
+
+
+def utf16z(s):
+    return s.encode("utf-16-le") + b"\0\0"
+
+
+def schema(tree, extended, ascii_names):
+    """tree: nested {name: subtree or None}; None marks an item. Returns the
+    section content and {path: item index}."""
+    nodes, items, scope_count = [], {}, [0]
+
+    def walk(name, subtree, parent, path):
+        index = len(nodes)
+        nodes.append([name, parent, subtree is not None, 0])
+        if subtree is None:
+            nodes[index][3] = len(items)
+            items["\\".join(path)] = len(items)
+            return
+        nodes[index][3] = scope_count[0]
+        scope_count[0] += 1
+        for child, sub in subtree.items():
+            walk(child, sub, index, path + [child])
+
+    walk("", tree, 0xffff, [])
+    unicode, ascii, infos = b"", b"", b""
+    for name, parent, is_scope, index in nodes:
+        flags = 0x10 if is_scope else 0
+        offset = 0
+        if name and ascii_names and name.isascii():
+            flags |= 0x20
+            offset = len(ascii)
+            ascii += name.encode("ascii") + b"\0"
+        elif name:
+            offset = len(unicode) // 2
+            unicode += utf16z(name)
+        flags |= offset >> 16 & 0xf
+        first = ord(name[0].upper()) if name else 0
+        infos += u16(parent, len(name), first) + bytes([len(name), flags])
+        infos += u16(offset & 0xffff, index)
+    scopes = scope_count[0]
+    total = len(nodes)
+    unique, display = "ms-appx://PinToTop.Fixture/", "PinToTop.Fixture"
+    out = u16(1, len(unique) + 1, len(display) + 1, 0)
+    if extended:
+        out += b"[def_hnamesx]  \0" if ascii_names else b"[def_hnames]   \0"
+    out += u16(1, 0) + u32(0, 0x5eed, scopes, len(items))
+    out += utf16z(unique) + utf16z(display)
+    out += u16(0, 64, 0) + u32(total, scopes, len(items),
+                               len(unicode) // 2, 0)
+    if extended and ascii_names:
+        out += u32(0)
+    out += infos
+    for i in range(scopes):
+        out += u16(i, 0, 0, 0)
+    for i in range(len(items)):
+        out += u16(i)
+    return out + unicode + ascii, items
+
+
+def decision_info(decisions):
+    """decisions: list of decisions, each a list of qualifier sets, each a
+    list of (qualifier, value). Identical qualifiers and sets are shared."""
+    distinct, sets, strings = [], [], b""
+    index, decision_entries, set_entries = [], [], []
+    for decision in decisions:
+        set_ids = []
+        for qualifier_set in decision:
+            quals = []
+            for qualifier in qualifier_set:
+                if qualifier not in distinct:
+                    distinct.append(qualifier)
+                quals.append(distinct.index(qualifier))
+            if quals not in sets:
+                sets.append(quals)
+                set_entries.append((len(index), len(quals)))
+                index += quals
+            set_ids.append(sets.index(quals))
+        decision_entries.append((len(index), len(set_ids)))
+        index += set_ids
+    distinct_data = b""
+    for name, value in distinct:
+        distinct_data += u16(0, QUALIFIERS[name], 0, 0)
+        distinct_data += u32(len(strings) // 2)
+        strings += utf16z(value)
+    out = u16(len(distinct), len(distinct), len(sets), len(decisions),
+              len(index), len(strings) // 2)
+    for first, count in decision_entries + set_entries:
+        out += u16(first, count)
+    for i in range(len(distinct)):
+        out += u16(i, 100, 0, 0)
+    return out + distinct_data + u16(*index) + strings
+
+
+def data_items(values):
+    """values: byte strings stored as blobs."""
+    out = u32(0) + u16(0, len(values)) + u32(sum(map(len, values)))
+    data = b""
+    for value in values:
+        out += u32(len(data), len(value))
+        data += value
+    return out + data
+
+
+def resource_map(schema_index, decision_index, types, infos, candidates,
+                 large):
+    """infos: (decision, first candidate) per item, in item order.
+    candidates: ("inline", type slot, bytes) or
+    ("item", type slot, source file, item index, section index)."""
+    strings, entries = b"", b""
+    for candidate in candidates:
+        if candidate[0] == "inline":
+            _, slot, value = candidate
+            entries += bytes([0, slot]) + u16(len(value)) + u32(len(strings))
+            strings += value
+        else:
+            _, slot, source, item, section = candidate
+            entries += bytes([1, slot]) + u16(source, item, section)
+    type_table = b"".join(u32(0, t) for t in types)
+    if large:
+        # One item map covering every item through a single group.
+        tables = u32(1, 1, len(infos)) + u32(0, 0) + u32(len(infos), 0)
+        tables += b"".join(u32(*info) for info in infos)
+        small, large_len = b"", len(tables)
+        counts = (0, 0, 0)
+    else:
+        small = u16(0, 0) + u16(len(infos), 0)
+        small += b"".join(u16(*info) for info in infos)
+        tables, large_len = b"", 0
+        counts = (1, 1, len(infos))
+    out = u16(0, 0, schema_index, 0, decision_index, len(types), counts[0],
+              counts[1]) + u32(counts[2], len(candidates), len(strings),
+                               large_len)
+    return out + type_table + small + tables + entries + strings
+
+
+def section(tag, content):
+    length = 32 + len(content) + 8
+    return (tag + u32(0) + u16(0, 0) + u32(length, 0) + content +
+            u32(0xdef5fade, length))
+
+
+def pri_file(magic, sections):
+    toc_offset = 32
+    start = toc_offset + 32 * len(sections)
+    toc, body = b"", b""
+    for tag, content in sections:
+        data = section(tag, content)
+        toc += tag + u16(0, 0) + u32(0, len(body), len(data))
+        body += data
+    total = start + len(body) + 16
+    header = magic + u16(0, 1) + u32(total, toc_offset, start)
+    header += u16(len(sections), 0xffff) + u32(0)
+    return header + toc + body + u32(0xdefffade, total) + magic
+
+
+def hschema():
+    content, items = schema({
+        "Files": {"Assets": {"Square44x44Logo.png": None,
+                             "StoreLogo.png": None}},
+        "resources": {"AppDisplayName": None},
+    }, extended=False, ascii_names=False)
+    assert items == {"Files\\Assets\\Square44x44Logo.png": 0,
+                     "Files\\Assets\\StoreLogo.png": 1,
+                     "resources\\AppDisplayName": 2}
+    decisions = decision_info([
+        [[("scale", "100")], [("scale", "200")],
+         [("targetsize", "24"), ("altform", "UNPLATED")],
+         [("targetsize", "24"), ("contrast", "BLACK")]],
+        [[]],
+        [[("language", "EN-US")], [("language", "DE-DE")]],
+    ])
+    paths = ["Assets\\Square44x44Logo.scale-100.png",
+             "Assets\\Square44x44Logo.scale-200.png",
+             "Assets\\Square44x44Logo.targetsize-24_altform-unplated.png",
+             "Assets\\Square44x44Logo.targetsize-24_contrast-black.png",
+             "Assets\\StoreLogo.png"]
+    candidates = [("inline", 0, utf16z(p)) for p in paths]
+    candidates += [("inline", 1, utf16z("PinToTop")),
+                   ("inline", 1, utf16z("Oben halten"))]
+    res_map = resource_map(1, 2, [VALUE_PATH, VALUE_STRING],
+                           [(0, 0), (1, 4), (2, 5)], candidates, large=False)
+    return pri_file(b"mrm_pri2", [
+        (b"[mrm_pridescex]\0", bytes(20)),
+        (b"[mrm_hschema]  \0", content),
+        (b"[mrm_decn_info]\0", decisions),
+        (b"[mrm_res_map2_]\0", res_map),
+    ])
+
+
+def hschemaex():
+    content, items = schema({
+        "Files": {"Images": {"AppList.png": None,
+                             "Kachelübersicht.png": None}},
+    }, extended=True, ascii_names=True)
+    assert items == {"Files\\Images\\AppList.png": 0,
+                     "Files\\Images\\Kachelübersicht.png": 1}
+    decisions = decision_info([
+        [[("scale", "100")], [("scale", "150")], [("targetsize", "16")],
+         [("scale", "400")]],
+        [[("contrast", "WHITE")]],
+    ])
+    blobs = ["Images\\AppList.scale-100.png".encode(),
+             "Images\\AppList.scale-150.png".encode(),
+             "Images\\AppList.targetsize-16.png".encode("ascii"),
+             "Images\\Kachelübersicht.contrast-white.png".encode()]
+    candidates = [("item", 0, 0, 0, 3), ("item", 0, 0, 1, 3),
+                  ("item", 1, 0, 2, 3), ("item", 0, 1, 0, 3),
+                  ("item", 0, 0, 3, 3)]
+    res_map = resource_map(1, 2, [VALUE_UTF8_PATH, VALUE_ASCII_PATH],
+                           [(0, 0), (1, 4)], candidates, large=True)
+    return pri_file(b"mrm_prif", [
+        (b"[mrm_pridescex]\0", bytes(20)),
+        (b"[mrm_hschemaex] ", content),
+        (b"[mrm_decn_info]\0", decisions),
+        (b"[mrm_dataitem] \0", data_items(blobs)),
+        (b"[mrm_res_map2_]\0", res_map),
+    ])
+
+
+def main():
+    here = Path(__file__).parent
+    (here / "hschema.pri").write_bytes(hschema())
+    (here / "hschemaex.pri").write_bytes(hschemaex())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,26 @@
+#include "appx_manifest.h"
+
+#include <cstdlib>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data,
+                                      std::size_t size) {
+  auto xml{reinterpret_cast<const char *>(data)};
+  auto inside = [&](std::string_view view) {
+    if (!view.empty() &&
+        (view.data() < xml || view.size() > size ||
+         std::size_t(view.data() - xml) > size - view.size())) {
+      std::abort();
+    }
+  };
+  if (auto apps{scan_appx_manifest(xml, size)}) {
+    for (const auto &app : *apps) {
+      for (auto field : {app.id, app.square44x44_logo, app.square150x150_logo,
+                         app.background_color}) {
+        inside(field);
+        unescape_xml(field);
+      }
+    }
+  }
+  unescape_xml({xml, size});
+  return 0;
+}
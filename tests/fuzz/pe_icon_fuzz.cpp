@@ -0,0 +1,22 @@
+#include "pe_icon.h"
+
+#include <cstdlib>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data,
+                                      std::size_t size) {
+  for (int cx : {16, 20, 32, 256}) {
+    auto icon{find_pe_icon(data, size, cx)};
+    if (!icon) {
+      continue;
+    }
+    if (icon->data < data || icon->size > size ||
+        std::size_t(icon->data - data) > size - icon->size) {
+      std::abort();
+    }
+    if (make_ico(*icon).size() != 22 + icon->size) {
+      std::abort();
+    }
+  }
+  find_pe_file_version(data, size);
+  return 0;
+}
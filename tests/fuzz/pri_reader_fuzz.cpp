@@ -0,0 +1,10 @@
+#include "pri_reader.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data,
+                                      std::size_t size) {
+  for (auto resource : {u"Files\\Assets\\Square44x44Logo.png",
+                        u"Files\\Images\\AppList.png", u"a/b", u""}) {
+    find_pri_candidates(data, size, resource);
+  }
+  return 0;
+}
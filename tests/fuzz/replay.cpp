@@ -0,0 +1,30 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data,
+                                      std::size_t size);
+
+// Feeds every prefix of each input to the fuzz target. Each prefix is copied
+// into its own buffer so that reads past the end trip sanitizers.
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::ifstream in{argv[i], std::ios::binary};
+    if (!in) {
+      std::fprintf(stderr, "cannot open %s\n", argv[i]);
+      return 1;
+    }
+    std::vector<std::uint8_t> input{std::istreambuf_iterator<char>{in}, {}};
+    std::size_t step = input.size() > 16384 ? 7 : 1;
+    for (std::size_t len = 0; len <= input.size(); len += step) {
+      std::vector<std::uint8_t> prefix(input.begin(),
+                                       input.begin() + std::ptrdiff_t(len));
+      LLVMFuzzerTestOneInput(prefix.data(), prefix.size());
+    }
+    LLVMFuzzerTestOneInput(input.data(), input.size());
+  }
+  return 0;
+}
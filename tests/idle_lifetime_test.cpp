@@ -0,0 +1,126 @@
+#include "check.h"
+#include "idle_lifetime.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// idle_lifetime never reads the clock itself; tests pass every time point.
+struct fake_clock {
+  using rep = long long;
+  using period = std::milli;
+  using duration = std::chrono::duration<rep, period>;
+  using time_point = std::chrono::time_point<fake_clock>;
+  static constexpr bool is_steady = true;
+};
+
+using lifetime = idle_lifetime<fake_clock>;
+const fake_clock::time_point t0{};
+
+struct counters {
+  int acquired = 0;
+  int released = 0;
+  bool release_ok = true;
+
+  auto acquire() {
+    return [this] { ++acquired; };
+  }
+  auto release() {
+    return [this] {
+      ++released;
+      return release_ok;
+    };
+  }
+};
+
+void test_acquire_release_counts() {
+  lifetime idle{60s};
+  counters c;
+  CHECK(!idle.alive());
+  CHECK(!idle.due());
+  CHECK(idle.use(t0, c.acquire()));
+  CHECK(!idle.use(t0 + 1s, c.acquire()));
+  CHECK(idle.alive());
+  CHECK(c.acquired == 1);
+  CHECK(idle.acquisitions() == 1);
+  CHECK(idle.due() == t0 + 61s);
+  CHECK(!idle.poll(t0 + 60s, c.release()));
+  CHECK(c.released == 0);
+  CHECK(idle.poll(t0 + 61s, c.release()));
+  CHECK(!idle.alive());
+  CHECK(idle.releases() == 1);
+  CHECK(!idle.due());
+  CHECK(!idle.poll(t0 + 200s, c.release()));
+  CHECK(c.released == 1);
+  CHECK(idle.use(t0 + 300s, c.acquire()));
+  CHECK(idle.acquisitions() == 2);
+  CHECK(idle.due() == t0 + 360s);
+}
+
+void test_hold_blocks_release() {
+  lifetime idle{60s};
+  counters c;
+  idle.use(t0, c.acquire());
+  idle.hold();
+  CHECK(!idle.due());
+  CHECK(!idle.poll(t0 + 10min, c.release()));
+  CHECK(c.released == 0);
+  CHECK(idle.alive());
+  // The timeout restarts when the hold ends, not from the last use.
+  idle.unhold(t0 + 10min);
+  CHECK(idle.due() == t0 + 11min);
+  CHECK(!idle.poll(t0 + 10min + 59s, c.release()));
+  CHECK(idle.poll(t0 + 11min, c.release()));
+  CHECK(c.released == 1);
+}
+
+void test_zero_timeout_disables_release() {
+  lifetime idle{0s};
+  counters c;
+  idle.use(t0, c.acquire());
+  CHECK(!idle.due());
+  CHECK(!idle.poll(t0 + 24h, c.release()));
+  CHECK(idle.alive());
+  idle.set_timeout(5s);
+  CHECK(idle.due() == t0 + 5s);
+  idle.set_timeout(-1s);
+  CHECK(!idle.due());
+  CHECK(!idle.poll(t0 + 24h, c.release()));
+  CHECK(c.released == 0);
+}
+
+void test_failed_release_retries() {
+  lifetime idle{60s};
+  counters c;
+  idle.use(t0, c.acquire());
+  c.release_ok = false;
+  CHECK(!idle.poll(t0 + 60s, c.release()));
+  CHECK(c.released == 1);
+  CHECK(idle.alive());
+  CHECK(idle.releases() == 0);
+  // A failed release waits a full timeout before the next attempt.
+  CHECK(idle.due() == t0 + 120s);
+  CHECK(!idle.poll(t0 + 119s, c.release()));
+  CHECK(c.released == 1);
+  // The resources are still loaded, so using them does not acquire again.
+  CHECK(!idle.use(t0 + 150s, c.acquire()));
+  CHECK(c.acquired == 1);
+  CHECK(idle.due() == t0 + 210s);
+  c.release_ok = true;
+  CHECK(idle.poll(t0 + 210s, c.release()));
+  CHECK(c.released == 2);
+  CHECK(!idle.alive());
+  CHECK(idle.releases() == 1);
+  CHECK(idle.use(t0 + 220s, c.acquire()));
+  CHECK(c.acquired == 2);
+}
+
+} // namespace
+
+int main() {
+  test_acquire_release_counts();
+  test_hold_blocks_release();
+  test_zero_timeout_disables_release();
+  test_failed_release_retries();
+  return check_result();
+}
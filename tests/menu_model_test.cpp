@@ -0,0 +1,105 @@
+#include "check.h"
+#include "menu_model.h"
+
+namespace {
+
+using model = menu_model<int>;
+
+std::pair<std::wstring, bool> describe(int wnd) {
+  return {L"window " + std::to_wstring(wnd), wnd % 2 == 0};
+}
+
+void test_build_layout() {
+  model menu;
+  auto slots{menu.build({10, 11, 12}, describe, L"Keep on top", true, L"Exit")};
+  const auto &entries{menu.entries()};
+  REQUIRE(entries.size() == 6);
+  for (std::size_t i = 0; i < 3; ++i) {
+    CHECK(entries[i].kind == menu_entry_kind::window);
+    CHECK(entries[i].wnd == int(10 + i));
+    CHECK(entries[i].text == L"window " + std::to_wstring(10 + i));
+    CHECK(entries[i].checked == (i % 2 == 0));
+    CHECK(!entries[i].icon);
+  }
+  CHECK(entries[3].kind == menu_entry_kind::separator);
+  CHECK(entries[4].kind == menu_entry_kind::enforce_topmost);
+  CHECK(entries[4].text == L"Keep on top");
+  CHECK(entries[4].checked);
+  CHECK(entries[5].kind == menu_entry_kind::exit);
+  CHECK(entries[5].text == L"Exit");
+  CHECK(!entries[5].checked);
+  REQUIRE(slots.size() == 3);
+  for (std::size_t i = 0; i < 3; ++i) {
+    CHECK(slots[i].first == int(10 + i));
+    CHECK(slots[i].second.generation == menu.generation());
+    CHECK(slots[i].second.index == i);
+  }
+}
+
+void test_build_without_windows() {
+  model menu;
+  auto slots{menu.build({}, describe, L"Keep on top", false, L"Exit")};
+  CHECK(slots.empty());
+  const auto &entries{menu.entries()};
+  REQUIRE(entries.size() == 2);
+  CHECK(entries[0].kind == menu_entry_kind::enforce_topmost);
+  CHECK(!entries[0].checked);
+  CHECK(entries[1].kind == menu_entry_kind::exit);
+}
+
+void test_generation_invalidation() {
+  model menu;
+  auto old_slots{menu.build({1, 2}, describe, L"", false, L"")};
+  auto old_gen{menu.generation()};
+  CHECK(menu.find(old_slots[0].second));
+  auto new_slots{menu.build({3}, describe, L"", false, L"")};
+  CHECK(menu.generation() == old_gen + 1);
+  // Slots from the previous menu neither resolve nor accept icons, even
+  // where their index is still in range.
+  CHECK(!menu.current(old_slots[0].second));
+  CHECK(!menu.find(old_slots[0].second));
+  CHECK(!menu.set_icon(old_slots[0].second, L"stale.png"));
+  CHECK(!menu.entries()[0].icon);
+  CHECK(menu.set_icon(new_slots[0].second, L"fresh.png"));
+  auto entry{menu.find(new_slots[0].second)};
+  REQUIRE(entry);
+  CHECK(entry->wnd == 3);
+  CHECK(entry->icon == L"fresh.png");
+  menu.reset();
+  CHECK(menu.entries().empty());
+  CHECK(!menu.find(new_slots[0].second));
+}
+
+void test_set_icon_rejects_non_windows() {
+  model menu;
+  menu.build({1}, describe, L"", false, L"");
+  CHECK(!menu.set_icon(menu.slot(1), L"separator.png"));
+  CHECK(!menu.set_icon(menu.slot(2), L"enforce.png"));
+  CHECK(!menu.set_icon(menu.slot(3), L"exit.png"));
+  CHECK(!menu.set_icon(menu.slot(4), L"out-of-range.png"));
+  for (const auto &entry : menu.entries()) {
+    CHECK(!entry.icon);
+  }
+  CHECK(menu.set_icon(menu.slot(0), L"window.png"));
+  CHECK(menu.find(menu.slot(0))->icon == L"window.png");
+}
+
+void test_slot_lookup() {
+  model menu;
+  menu.build({7}, describe, L"", false, L"");
+  auto entry{menu.find(menu.slot(3))};
+  REQUIRE(entry);
+  CHECK(entry->kind == menu_entry_kind::exit);
+  CHECK(!menu.find(menu.slot(4)));
+}
+
+} // namespace
+
+int main() {
+  test_build_layout();
+  test_build_without_windows();
+  test_generation_invalidation();
+  test_set_icon_rejects_non_windows();
+  test_slot_lookup();
+  return check_result();
+}
@@ -0,0 +1,113 @@
+#include "check.h"
+#include "pe_icon.h"
+
+#include <cstring>
+
+namespace {
+
+void test_distlib(const char *name) {
+  auto image{read_fixture(name)};
+  struct {
+    int cx;
+    std::uint8_t width;
+    std::size_t size;
+  } cases[] = {{16, 16, 1128}, {20, 32, 4264}, {24, 32, 4264},
+               {32, 32, 4264}, {48, 48, 9640}, {256, 48, 9640}};
+  for (const auto &c : cases) {
+    auto icon{find_pe_icon(image.data(), image.size(), c.cx)};
+    REQUIRE(icon);
+    CHECK(icon->width == c.width);
+    CHECK(icon->height == c.width);
+    CHECK(icon->bit_count == 32);
+    CHECK(icon->planes == 1);
+    CHECK(!icon->is_png);
+    CHECK(icon->size == c.size);
+    CHECK(icon->data > image.data());
+    CHECK(icon->data + icon->size <= image.data() + image.size());
+  }
+  CHECK(find_pe_file_version(image.data(), image.size()) ==
+        0x000100010000000eull);
+}
+
+void test_png_icon() {
+  auto image{read_fixture("pe/png_icon.exe")};
+  auto small{find_pe_icon(image.data(), image.size(), 16)};
+  REQUIRE(small);
+  CHECK(small->width == 16);
+  CHECK(!small->is_png);
+  CHECK(small->size == 1128);
+  auto large{find_pe_icon(image.data(), image.size(), 32)};
+  REQUIRE(large);
+  CHECK(large->width == 0);
+  CHECK(large->height == 0);
+  CHECK(large->is_png);
+  CHECK(std::memcmp(large->data + 12, "IHDR", 4) == 0);
+  auto exact{find_pe_icon(image.data(), image.size(), 256)};
+  REQUIRE(exact);
+  CHECK(exact->data == large->data);
+  CHECK(find_pe_file_version(image.data(), image.size()) ==
+        0x0002000300040005ull);
+}
+
+void test_make_ico() {
+  auto image{read_fixture("pe/png_icon.exe")};
+  auto icon{find_pe_icon(image.data(), image.size(), 16)};
+  REQUIRE(icon);
+  auto ico{make_ico(*icon)};
+  REQUIRE(ico.size() == 22 + icon->size);
+  const std::uint8_t header[] = {0, 0, 1, 0, 1, 0, 16, 16, 0, 0, 1, 0, 32, 0};
+  CHECK(std::memcmp(ico.data(), header, sizeof(header)) == 0);
+  std::uint32_t bytes = ico[14] | ico[15] << 8 | ico[16] << 16 |
+                        std::uint32_t(ico[17]) << 24;
+  std::uint32_t offset = ico[18] | ico[19] << 8 | ico[20] << 16 |
+                         std::uint32_t(ico[21]) << 24;
+  CHECK(bytes == icon->size);
+  CHECK(offset == 22);
+  CHECK(std::memcmp(ico.data() + 22, icon->data, icon->size) == 0);
+}
+
+void test_truncated(const char *name) {
+  auto image{read_fixture(name)};
+  auto full{find_pe_icon(image.data(), image.size(), 32)};
+  REQUIRE(full);
+  std::size_t icon_end = std::size_t(full->data - image.data()) + full->size;
+  for (std::size_t len = 0; len < image.size(); ++len) {
+    std::vector<std::uint8_t> prefix(image.begin(),
+                                     image.begin() + std::ptrdiff_t(len));
+    auto icon{find_pe_icon(prefix.data(), prefix.size(), 32)};
+    if (len < icon_end) {
+      CHECK(!icon);
+    } else if (icon) {
+      CHECK(icon->size == full->size);
+    }
+    find_pe_file_version(prefix.data(), prefix.size());
+  }
+}
+
+void test_rejects_non_pe() {
+  CHECK(!find_pe_icon(nullptr, 0, 16));
+  CHECK(!find_pe_file_version(nullptr, 0));
+  auto image{read_fixture("pe/png_icon.exe")};
+  image[0] = 'X';
+  CHECK(!find_pe_icon(image.data(), image.size(), 16));
+  image[0] = 'M';
+  image[0x40] = 'X';
+  CHECK(!find_pe_icon(image.data(), image.size(), 16));
+  image[0x40] = 'P';
+  image[0x58] = 0;
+  CHECK(!find_pe_icon(image.data(), image.size(), 16));
+  CHECK(!find_pe_file_version(image.data(), image.size()));
+}
+
+} // namespace
+
+int main() {
+  test_distlib("pe/distlib_w32.exe");
+  test_distlib("pe/distlib_w64.exe");
+  test_png_icon();
+  test_make_ico();
+  test_truncated("pe/distlib_w64.exe");
+  test_truncated("pe/png_icon.exe");
+  test_rejects_non_pe();
+  return check_result();
+}
@@ -0,0 +1,61 @@
+#include "check.h"
+#include "pri_reader.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+std::u16string widen(const std::string &s) { return {s.begin(), s.end()}; }
+
+// <name>.expected holds the resource to look up on its first line and one
+// candidate per following line, in order: the path, then name=value
+// qualifiers, separated by spaces. Only ASCII is supported.
+void check_corpus_file(const std::string &pri_path) {
+  auto pri{read_file(pri_path)};
+  std::string expected_path{pri_path.substr(0, pri_path.size() - 4) +
+                            ".expected"};
+  std::ifstream expected{expected_path};
+  REQUIRE(expected);
+  std::string resource;
+  REQUIRE(std::getline(expected, resource));
+  std::vector<pri_candidate> want;
+  for (std::string line; std::getline(expected, line);) {
+    std::istringstream fields{line};
+    std::string path, qualifier;
+    if (!(fields >> path)) {
+      continue;
+    }
+    pri_candidate candidate{widen(path), {}};
+    while (fields >> qualifier) {
+      auto eq{qualifier.find('=')};
+      REQUIRE(eq != std::string::npos);
+      candidate.qualifiers.push_back(
+          {widen(qualifier.substr(0, eq)), widen(qualifier.substr(eq + 1))});
+    }
+    want.push_back(std::move(candidate));
+  }
+  auto found{find_pri_candidates(pri.data(), pri.size(), widen(resource))};
+  REQUIRE(found);
+  CHECK(found->size() == want.size());
+  for (std::size_t i = 0; i < std::min(found->size(), want.size()); ++i) {
+    if ((*found)[i].path != want[i].path ||
+        (*found)[i].qualifiers != want[i].qualifiers) {
+      std::fprintf(stderr, "%s: candidate %zu differs\n", pri_path.c_str(),
+                   i);
+      ++check_failures;
+    }
+  }
+}
+
+} // namespace
+
+// Checks real resources.pri files, passed as arguments, against the
+// candidates recorded next to them.
+int main(int argc, char **argv) {
+  REQUIRE(argc > 1);
+  for (int i = 1; i < argc; ++i) {
+    check_corpus_file(argv[i]);
+  }
+  return check_result();
+}
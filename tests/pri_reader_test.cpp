@@ -0,0 +1,120 @@
+#include "check.h"
+#include "pri_reader.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+using qualifiers = std::vector<std::pair<std::u16string, std::u16string>>;
+
+struct expected {
+  std::u16string path;
+  qualifiers quals;
+};
+
+bool matches(const std::optional<std::vector<pri_candidate>> &found,
+             const std::vector<expected> &want) {
+  if (!found || found->size() != want.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < want.size(); ++i) {
+    if ((*found)[i].path != want[i].path ||
+        (*found)[i].qualifiers != want[i].quals) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::optional<std::vector<pri_candidate>>
+lookup(const std::vector<std::uint8_t> &pri, std::u16string_view resource) {
+  return find_pri_candidates(pri.data(), pri.size(), resource);
+}
+
+void test_hschema() {
+  auto pri{read_fixture("pri/hschema.pri")};
+  std::vector<expected> logo{
+      {u"Assets\\Square44x44Logo.scale-100.png", {{u"scale", u"100"}}},
+      {u"Assets\\Square44x44Logo.scale-200.png", {{u"scale", u"200"}}},
+      {u"Assets\\Square44x44Logo.targetsize-24_altform-unplated.png",
+       {{u"targetsize", u"24"}, {u"altform", u"unplated"}}},
+      {u"Assets\\Square44x44Logo.targetsize-24_contrast-black.png",
+       {{u"targetsize", u"24"}, {u"contrast", u"black"}}},
+  };
+  CHECK(matches(lookup(pri, u"Files\\Assets\\Square44x44Logo.png"), logo));
+  CHECK(matches(lookup(pri, u"files/assets/SQUARE44X44LOGO.png"), logo));
+  CHECK(matches(lookup(pri, u"Files\\Assets\\StoreLogo.png"),
+                {{u"Assets\\StoreLogo.png", {}}}));
+  // Only string candidates, which are not files.
+  CHECK(!lookup(pri, u"resources\\AppDisplayName"));
+  CHECK(!lookup(pri, u"Assets\\StoreLogo.png"));
+  CHECK(!lookup(pri, u"Files\\Assets"));
+  CHECK(!lookup(pri, u"Files\\Assets\\Missing.png"));
+  CHECK(!lookup(pri, u""));
+}
+
+void test_hschemaex() {
+  auto pri{read_fixture("pri/hschemaex.pri")};
+  // The fourth candidate of AppList.png lives in another source file.
+  CHECK(matches(lookup(pri, u"Files\\Images\\AppList.png"),
+                {{u"Images\\AppList.scale-100.png", {{u"scale", u"100"}}},
+                 {u"Images\\AppList.scale-150.png", {{u"scale", u"150"}}},
+                 {u"Images\\AppList.targetsize-16.png",
+                  {{u"targetsize", u"16"}}}}));
+  CHECK(matches(lookup(pri, u"Files\\Images\\Kachelübersicht.png"),
+                {{u"Images\\Kachelübersicht.contrast-white.png",
+                  {{u"contrast", u"white"}}}}));
+}
+
+void test_schema_counts() {
+  auto pri{read_fixture("pri/hschema.pri")};
+  // Node, scope and item counts repeated after the names: 7, 4, 3.
+  const std::uint8_t counts[] = {7, 0, 0, 0, 4, 0, 0, 0, 3, 0, 0, 0};
+  auto it{std::search(pri.begin(), pri.end(), std::begin(counts),
+                      std::end(counts))};
+  REQUIRE(it != pri.end());
+  CHECK(lookup(pri, u"Files\\Assets\\StoreLogo.png"));
+  // The triple is read at its fixed offset, so moving it breaks the schema.
+  std::rotate(it - 2, it, it + sizeof(counts));
+  CHECK(!lookup(pri, u"Files\\Assets\\StoreLogo.png"));
+  std::rotate(it - 2, it + sizeof(counts) - 2, it + sizeof(counts));
+  CHECK(lookup(pri, u"Files\\Assets\\StoreLogo.png"));
+  *it = 8;
+  CHECK(!lookup(pri, u"Files\\Assets\\StoreLogo.png"));
+}
+
+void test_truncated(const char *name, std::u16string_view resource) {
+  auto pri{read_fixture(name)};
+  for (std::size_t len = 0; len < pri.size(); ++len) {
+    std::vector<std::uint8_t> prefix(pri.begin(),
+                                     pri.begin() + std::ptrdiff_t(len));
+    CHECK(!lookup(prefix, resource));
+  }
+}
+
+void test_rejects_bad_headers() {
+  CHECK(!find_pri_candidates(nullptr, 0, u"Files\\Assets\\StoreLogo.png"));
+  auto pri{read_fixture("pri/hschema.pri")};
+  auto bad_magic{pri};
+  std::memcpy(bad_magic.data(), "mrm_prix", 8);
+  CHECK(!lookup(bad_magic, u"Files\\Assets\\StoreLogo.png"));
+  auto bad_trailer{pri};
+  bad_trailer[bad_trailer.size() - 16] ^= 1;
+  CHECK(!lookup(bad_trailer, u"Files\\Assets\\StoreLogo.png"));
+  auto padded{pri};
+  padded.resize(pri.size() + 64);
+  CHECK(lookup(padded, u"Files\\Assets\\StoreLogo.png"));
+}
+
+} // namespace
+
+int main() {
+  test_hschema();
+  test_hschemaex();
+  test_schema_counts();
+  test_truncated("pri/hschema.pri", u"Files\\Assets\\Square44x44Logo.png");
+  test_truncated("pri/hschemaex.pri", u"Files\\Images\\AppList.png");
+  test_rejects_bad_headers();
+  return check_result();
+}
@@ -0,0 +1,139 @@
+#include "check.h"
+#include "request_coalescer.h"
+
+#include <map>
+#include <string>
+
+namespace {
+
+using coalescer = request_coalescer<std::string, int, int>;
+
+// Resolves requests the way the icon thread does: one resolver call per
+// key, whose result is handed to every waiter.
+struct fake_resolver {
+  explicit fake_resolver(std::map<std::string, std::string> icons)
+      : icons{std::move(icons)} {}
+
+  std::map<std::string, std::string> icons;
+  std::vector<std::string> calls;
+  std::vector<std::pair<int, std::string>> delivered;
+
+  void drain(coalescer &c) {
+    while (auto request{c.next()}) {
+      calls.push_back(request->first);
+      auto uri{icons.at(request->first) + "#" +
+               std::to_string(request->second)};
+      for (int waiter : c.complete(request->first)) {
+        delivered.push_back({waiter, uri});
+      }
+    }
+  }
+};
+
+void test_fan_out() {
+  coalescer c;
+  fake_resolver resolver{{{"notepad", "notepad.png"}, {"edge", "edge.png"}}};
+  c.enqueue("notepad", 100, 0);
+  c.enqueue("edge", 200, 1);
+  c.enqueue("notepad", 101, 2);
+  c.enqueue("notepad", 102, 3);
+  CHECK(c.requests() == 4);
+  CHECK(c.calls() == 2);
+  resolver.drain(c);
+  CHECK(c.empty());
+  CHECK((resolver.calls == std::vector<std::string>{"notepad", "edge"}));
+  // Every waiter gets the result resolved with the first request's argument.
+  CHECK((resolver.delivered == std::vector<std::pair<int, std::string>>{
+                                   {0, "notepad.png#100"},
+                                   {2, "notepad.png#100"},
+                                   {3, "notepad.png#100"},
+                                   {1, "edge.png#200"}}));
+}
+
+void test_order() {
+  coalescer c;
+  fake_resolver resolver{{{"a", "a"}, {"b", "b"}, {"c", "c"}}};
+  for (auto key : {"c", "a", "c", "b", "a"}) {
+    c.enqueue(key, 0, 0);
+  }
+  resolver.drain(c);
+  CHECK((resolver.calls == std::vector<std::string>{"c", "a", "b"}));
+}
+
+void test_join_in_flight() {
+  coalescer c;
+  c.enqueue("a", 1, 0);
+  c.enqueue("b", 2, 1);
+  auto request{c.next()};
+  REQUIRE(request);
+  CHECK(request->first == "a");
+  CHECK(request->second == 1);
+  // A request arriving while "a" resolves joins the pending call.
+  c.enqueue("a", 3, 2);
+  CHECK(c.calls() == 2);
+  CHECK((c.complete("a") == std::vector<int>{0, 2}));
+  request = c.next();
+  REQUIRE(request);
+  CHECK(request->first == "b");
+}
+
+void test_prune() {
+  coalescer c;
+  c.enqueue("a", 1, 0);
+  c.enqueue("b", 2, 1);
+  c.enqueue("a", 3, 10);
+  c.enqueue("c", 4, 11);
+  // Waiters below 10 belong to a menu that has been replaced.
+  c.prune([](int waiter) { return waiter < 10; });
+  CHECK(c.calls() == 3);
+  auto request{c.next()};
+  REQUIRE(request);
+  CHECK(request->first == "a");
+  CHECK((c.complete("a") == std::vector<int>{10}));
+  request = c.next();
+  REQUIRE(request);
+  CHECK(request->first == "c");
+  // Pruning the call in flight leaves nothing for complete to hand out.
+  c.prune([](int) { return true; });
+  CHECK(c.empty());
+  CHECK(c.complete("c").empty());
+  CHECK(!c.next());
+}
+
+void test_reenqueue_after_complete() {
+  coalescer c;
+  fake_resolver resolver{{{"a", "a.png"}}};
+  c.enqueue("a", 1, 0);
+  resolver.drain(c);
+  c.enqueue("a", 2, 1);
+  CHECK(!c.empty());
+  CHECK(c.requests() == 2);
+  CHECK(c.calls() == 2);
+  resolver.drain(c);
+  CHECK((resolver.calls == std::vector<std::string>{"a", "a"}));
+  CHECK((resolver.delivered.back() ==
+         std::pair<int, std::string>{1, "a.png#2"}));
+}
+
+void test_complete_unknown() {
+  coalescer c;
+  CHECK(!c.next());
+  CHECK(c.complete("missing").empty());
+  c.enqueue("a", 1, 0);
+  CHECK(c.complete("missing").empty());
+  CHECK(!c.empty());
+  CHECK(c.requests() == 1);
+  CHECK(c.calls() == 1);
+}
+
+} // namespace
+
+int main() {
+  test_fan_out();
+  test_order();
+  test_join_in_flight();
+  test_prune();
+  test_reenqueue_after_complete();
+  test_complete_unknown();
+  return check_result();
+}
@@ -0,0 +1,176 @@
+#include "check.h"
+#include "topmost_guard.h"
+
+#include <map>
+
+namespace {
+
+using namespace std::chrono_literals;
+using clock_type = topmost_guard<int>::clock;
+
+const clock_type::time_point t0{};
+
+topmost_guard<int> make_guard() { return {100ms, 500ms, 3, 10s}; }
+
+std::vector<int> poll(topmost_guard<int> &guard, clock_type::time_point now,
+                      const std::map<int, pin_state> &states) {
+  return guard.poll(now, [&](int wnd) { return states.at(wnd); });
+}
+
+void test_nothing_pinned() {
+  auto guard{make_guard()};
+  CHECK(guard.empty());
+  guard.notify(t0);
+  CHECK(!guard.due());
+  CHECK(poll(guard, t0 + 1s, {}).empty());
+}
+
+void test_debounce_extension() {
+  auto guard{make_guard()};
+  guard.pin(1);
+  guard.notify(t0);
+  CHECK(guard.due() == t0 + 100ms);
+  guard.notify(t0 + 60ms);
+  CHECK(guard.due() == t0 + 160ms);
+  CHECK(poll(guard, t0 + 159ms, {{1, pin_state::lost}}).empty());
+  CHECK(guard.due() == t0 + 160ms);
+  CHECK(poll(guard, t0 + 160ms, {{1, pin_state::lost}}) ==
+        std::vector<int>{1});
+  CHECK(!guard.due());
+}
+
+void test_max_delay() {
+  auto guard{make_guard()};
+  guard.pin(1);
+  for (auto t{0ms}; t <= 900ms; t += 50ms) {
+    guard.notify(t0 + t);
+    CHECK(guard.due() <= t0 + 500ms);
+  }
+  CHECK(guard.due() == t0 + 500ms);
+  CHECK(poll(guard, t0 + 500ms, {{1, pin_state::lost}}) ==
+        std::vector<int>{1});
+  // A new burst of events starts a new max delay window.
+  guard.notify(t0 + 950ms);
+  CHECK(guard.due() == t0 + 1050ms);
+}
+
+void test_burst_limit() {
+  auto guard{make_guard()};
+  guard.pin(1);
+  std::map<int, pin_state> lost{{1, pin_state::lost}};
+  for (auto t : {1s, 2s, 3s}) {
+    guard.notify(t0 + t);
+    CHECK(poll(guard, t0 + t + 100ms, lost) == std::vector<int>{1});
+  }
+  guard.notify(t0 + 4s);
+  CHECK(poll(guard, t0 + 4s + 100ms, lost).empty());
+  // The first re-pin leaves the 10 s window at 11.1 s.
+  CHECK(guard.due() == t0 + 11s + 100ms);
+  guard.notify(t0 + 11s);
+  CHECK(poll(guard, t0 + 11s + 50ms, lost).empty());
+  CHECK(poll(guard, t0 + 11s + 100ms, lost) == std::vector<int>{1});
+  guard.notify(t0 + 11s + 200ms);
+  CHECK(poll(guard, t0 + 11s + 300ms, lost).empty());
+  CHECK(guard.due() == t0 + 12s + 100ms);
+}
+
+void test_rate_limited_recheck() {
+  auto guard{make_guard()};
+  guard.pin(1);
+  std::map<int, pin_state> lost{{1, pin_state::lost}};
+  for (auto t : {1s, 2s, 3s}) {
+    guard.notify(t0 + t);
+    CHECK(poll(guard, t0 + t + 100ms, lost) == std::vector<int>{1});
+  }
+  CHECK(!guard.due());
+  guard.notify(t0 + 4s);
+  CHECK(poll(guard, t0 + 4s + 100ms, lost).empty());
+  // No further events: the window is re-pinned once the budget allows.
+  CHECK(guard.due() == t0 + 11s + 100ms);
+  CHECK(poll(guard, t0 + 11s, lost).empty());
+  CHECK(poll(guard, t0 + 11s + 100ms, lost) == std::vector<int>{1});
+  CHECK(!guard.due());
+  // History is now 3.1 s, 11.1 s and 12.1 s, so the next loss waits for
+  // 13.1 s.
+  guard.notify(t0 + 12s);
+  CHECK(poll(guard, t0 + 12s + 100ms, lost) == std::vector<int>{1});
+  guard.notify(t0 + 12s + 500ms);
+  CHECK(poll(guard, t0 + 12s + 600ms, lost).empty());
+  CHECK(guard.due() == t0 + 13s + 100ms);
+  // A later debounce deadline neither replaces the re-check nor is dropped
+  // by it.
+  guard.notify(t0 + 13s + 50ms);
+  CHECK(guard.due() == t0 + 13s + 100ms);
+  CHECK(poll(guard, t0 + 13s + 100ms, lost) == std::vector<int>{1});
+  CHECK(guard.due() == t0 + 13s + 150ms);
+  CHECK(poll(guard, t0 + 13s + 150ms, {{1, pin_state::topmost}}).empty());
+  CHECK(!guard.due());
+}
+
+void test_topmost_windows_keep_budget() {
+  auto guard{make_guard()};
+  guard.pin(1);
+  for (auto t : {1s, 2s, 3s, 4s}) {
+    guard.notify(t0 + t);
+    CHECK(poll(guard, t0 + t + 100ms, {{1, pin_state::topmost}}).empty());
+  }
+  guard.notify(t0 + 5s);
+  CHECK(poll(guard, t0 + 5s + 100ms, {{1, pin_state::lost}}) ==
+        std::vector<int>{1});
+}
+
+void test_gone_windows_pruned() {
+  auto guard{make_guard()};
+  guard.pin(1);
+  guard.pin(2);
+  guard.notify(t0);
+  CHECK(poll(guard, t0 + 100ms, {{1, pin_state::gone}, {2, pin_state::lost}}) ==
+        std::vector<int>{2});
+  CHECK(!guard.empty());
+  // Window 1 is no longer asked about.
+  guard.notify(t0 + 1s);
+  CHECK(poll(guard, t0 + 1s + 100ms, {{2, pin_state::gone}}).empty());
+  CHECK(guard.empty());
+  guard.notify(t0 + 2s);
+  CHECK(!guard.due());
+}
+
+void test_unpin() {
+  auto guard{make_guard()};
+  guard.pin(1);
+  guard.pin(2);
+  guard.unpin(1);
+  guard.notify(t0);
+  CHECK(poll(guard, t0 + 100ms, {{2, pin_state::lost}}) ==
+        std::vector<int>{2});
+}
+
+void test_pin_resets_history() {
+  auto guard{make_guard()};
+  guard.pin(1);
+  std::map<int, pin_state> lost{{1, pin_state::lost}};
+  for (auto t : {1s, 2s, 3s}) {
+    guard.notify(t0 + t);
+    CHECK(poll(guard, t0 + t + 100ms, lost) == std::vector<int>{1});
+  }
+  guard.notify(t0 + 4s);
+  CHECK(poll(guard, t0 + 4s + 100ms, lost).empty());
+  guard.pin(1);
+  guard.notify(t0 + 5s);
+  CHECK(poll(guard, t0 + 5s + 100ms, lost) == std::vector<int>{1});
+}
+
+} // namespace
+
+int main() {
+  test_nothing_pinned();
+  test_debounce_extension();
+  test_max_delay();
+  test_burst_limit();
+  test_rate_limited_recheck();
+  test_topmost_windows_keep_budget();
+  test_gone_windows_pruned();
+  test_unpin();
+  test_pin_resets_history();
+  return check_result();
+}